@@ -1,8 +1,8 @@
 #include "GC9A01.h"
 
 #include <unistd.h>
+#include <time.h>
 
-#define ORIENTATION 2   // Set the display orientation 0,1,2,3
 
 // Command codes:
 #define COL_ADDR_SET        0x2A
@@ -13,6 +13,14 @@
 #define COLOR_MODE__16_BIT  0x05
 #define COLOR_MODE__18_BIT  0x06
 #define MEM_WR_CONT         0x3C //important 
+#define READ_ID             0x04 //RDDID: dummy clock + 24 bit ID
+#define READ_POWER_MODE     0x0A
+#define READ_MADCTL         0x0B
+#define READ_COLMOD         0x0C
+#define VSCROLL_DEF         0x33 //top fixed, scroll area, bottom fixed lines
+#define VSCROLL_START       0x37 //memory line shown at the top of the scroll area
+#define POWER_MODE_SLEEP_OUT  0x10
+#define POWER_MODE_DISPLAY_ON 0x04
 
 static void GC9A01_write_command(uint8_t cmd) {
     GC9A01_set_data_command(0);
@@ -28,261 +36,197 @@ static inline void GC9A01_write_byte(uint8_t val) {
     GC9A01_write_data(&val, sizeof(val));
 }
 
+//8 bit status reads have no dummy cycle
+static uint8_t GC9A01_read_reg8(uint8_t cmd) {
+    uint8_t val = 0;
+    GC9A01_write_command(cmd);
+    GC9A01_set_data_command(1);
+    GC9A01_spi_rx(&val, sizeof(val));
+    return val;
+}
+
+// MADCTL bits: the panel mirrors the column (MX) and page (MY) address
+// counters, then exchanges them (MV); BGR matches the panel's subpixels
+#define MADCTL              0x36
+#define MADCTL_MY           0x80
+#define MADCTL_MX           0x40
+#define MADCTL_MV           0x20
+#define MADCTL_BGR          0x08
+
+// Clockwise quarter turns, with columns always following framebuffer x
+// and pages framebuffer y, so every flush streams the framebuffer row-major
+static const uint8_t madctl_rotation[4] = {
+    0,
+    MADCTL_MV | MADCTL_MY,
+    MADCTL_MX | MADCTL_MY,
+    MADCTL_MV | MADCTL_MX,
+};
+
+#define DEFAULT_MADCTL (MADCTL_BGR | MADCTL_MV | MADCTL_MY) //rotation 1: the goggle optics
+static uint8_t madctl = DEFAULT_MADCTL;
+static int orientation[3] = { 1, 0, 0 }; //rotation, mirror_x, mirror_y behind madctl
+
+/* Initial Sequence as a table: command, parameter count, parameters.
+ * Each entry is one command byte (D/C low) and one parameter burst (D/C high). */
+static const uint8_t init_cmds[] = {
+    0xEF, 0,
+    0xEB, 1, 0x14,
+    0xFE, 0,
+    0xEF, 0,
+    0xEB, 1, 0x14,
+    0x84, 1, 0x40,
+    0x85, 1, 0xFF,
+    0x86, 1, 0xFF,
+    0x87, 1, 0xFF,
+    0x88, 1, 0x0A,
+    0x89, 1, 0x21,
+    0x8A, 1, 0x00,
+    0x8B, 1, 0x80,
+    0x8C, 1, 0x01,
+    0x8D, 1, 0x01,
+    0x8E, 1, 0xFF,
+    0x8F, 1, 0xFF,
+    0xB6, 2, 0x00, 0x00,
+    COLOR_MODE, 1, COLOR_MODE__16_BIT,
+    0x90, 4, 0x08, 0x08, 0x08, 0x08,
+    0xBD, 1, 0x06,
+    0xBC, 1, 0x00,
+    0xFF, 3, 0x60, 0x01, 0x04,
+    0xC3, 1, 0x13,
+    0xC4, 1, 0x13,
+    0xC9, 1, 0x22,
+    0xBE, 1, 0x11,
+    0xE1, 2, 0x10, 0x0E,
+    0xDF, 3, 0x21, 0x0c, 0x02,
+    0xF0, 6, 0x45, 0x09, 0x08, 0x08, 0x26, 0x2A,
+    0xF1, 6, 0x43, 0x70, 0x72, 0x36, 0x37, 0x6F,
+    0xF2, 6, 0x45, 0x09, 0x08, 0x08, 0x26, 0x2A,
+    0xF3, 6, 0x43, 0x70, 0x72, 0x36, 0x37, 0x6F,
+    0xED, 2, 0x1B, 0x0B,
+    0xAE, 1, 0x77,
+    0xCD, 1, 0x63,
+    0x70, 9, 0x07, 0x07, 0x04, 0x0E, 0x0F, 0x09, 0x07, 0x08, 0x03,
+    0xE8, 1, 0x34,
+    0x62, 12, 0x18, 0x0D, 0x71, 0xED, 0x70, 0x70, 0x18, 0x0F, 0x71, 0xEF, 0x70, 0x70,
+    0x63, 12, 0x18, 0x11, 0x71, 0xF1, 0x70, 0x70, 0x18, 0x13, 0x71, 0xF3, 0x70, 0x70,
+    0x64, 7, 0x28, 0x29, 0xF1, 0x01, 0xF1, 0x00, 0x07,
+    0x66, 10, 0x3C, 0x00, 0xCD, 0x67, 0x45, 0x45, 0x10, 0x00, 0x00, 0x00,
+    0x67, 10, 0x00, 0x3C, 0x00, 0x00, 0x00, 0x01, 0x54, 0x10, 0x32, 0x98,
+    0x74, 7, 0x10, 0x85, 0x80, 0x00, 0x00, 0x4E, 0x00,
+    0x98, 2, 0x3e, 0x07,
+    0x35, 0,   // tearing effect line on
+    0x21, 0,   // inversion on
+};
+
+// Datasheet minimums
+#define RESET_PULSE_US      10      // TRW: RESX low
+#define RESET_TO_CMD_US     5000    // TRT: RESX high to first command
+#define RESET_TO_SLPOUT_US  120000  // Sleep Out not allowed sooner after reset
+#define SLPOUT_TO_CMD_US    5000    // Sleep Out to next command
+
+static uint64_t elapsed_us(const struct timespec *since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec - since->tv_sec) * 1000000ull +
+           (uint64_t)((now.tv_nsec - since->tv_nsec) / 1000);
+}
+
 int GC9A01_init(void) {
-    
-    usleep(5000);
+    struct timespec reset_done;
+
     GC9A01_set_reset(0);
-    usleep(10000);
+    usleep(RESET_PULSE_US);
     GC9A01_set_reset(1);
-    usleep(120000);
-    
-    /* Initial Sequence */ 
-    
-    GC9A01_write_command(0xEF);
-    
-    GC9A01_write_command(0xEB);
-    GC9A01_write_byte(0x14);
-    
-    GC9A01_write_command(0xFE);
-    GC9A01_write_command(0xEF);
-    
-    GC9A01_write_command(0xEB);
-    GC9A01_write_byte(0x14);
-    
-    GC9A01_write_command(0x84);
-    GC9A01_write_byte(0x40);
-    
-    GC9A01_write_command(0x85);
-    GC9A01_write_byte(0xFF);
-    
-    GC9A01_write_command(0x86);
-    GC9A01_write_byte(0xFF);
-    
-    GC9A01_write_command(0x87);
-    GC9A01_write_byte(0xFF);
-    
-    GC9A01_write_command(0x88);
-    GC9A01_write_byte(0x0A);
-    
-    GC9A01_write_command(0x89);
-    GC9A01_write_byte(0x21);
-    
-    GC9A01_write_command(0x8A);
-    GC9A01_write_byte(0x00);
-    
-    GC9A01_write_command(0x8B);
-    GC9A01_write_byte(0x80);
-    
-    GC9A01_write_command(0x8C);
-    GC9A01_write_byte(0x01);
-    
-    GC9A01_write_command(0x8D);
-    GC9A01_write_byte(0x01);
-    
-    GC9A01_write_command(0x8E);
-    GC9A01_write_byte(0xFF);
-    
-    GC9A01_write_command(0x8F);
-    GC9A01_write_byte(0xFF);
-    
-    
-    GC9A01_write_command(0xB6);
-    GC9A01_write_byte(0x00);
-    GC9A01_write_byte(0x00);
-    
-    GC9A01_write_command(0x36);
-    
-#if ORIENTATION == 0
-    GC9A01_write_byte(0x18);
-#elif ORIENTATION == 1
-    GC9A01_write_byte(0x28);
-#elif ORIENTATION == 2
-    GC9A01_write_byte(0x48);
-#else
-    GC9A01_write_byte(0x88);
-#endif
-    
-    GC9A01_write_command(COLOR_MODE);
-    GC9A01_write_byte(COLOR_MODE__16_BIT);
-    
-    GC9A01_write_command(0x90);
-    GC9A01_write_byte(0x08);
-    GC9A01_write_byte(0x08);
-    GC9A01_write_byte(0x08);
-    GC9A01_write_byte(0x08);
-    
-    GC9A01_write_command(0xBD);
-    GC9A01_write_byte(0x06);
-    
-    GC9A01_write_command(0xBC);
-    GC9A01_write_byte(0x00);
-    
-    GC9A01_write_command(0xFF);
-    GC9A01_write_byte(0x60);
-    GC9A01_write_byte(0x01);
-    GC9A01_write_byte(0x04);
-    
-    GC9A01_write_command(0xC3);
-    GC9A01_write_byte(0x13);
-    GC9A01_write_command(0xC4);
-    GC9A01_write_byte(0x13);
-    
-    GC9A01_write_command(0xC9);
-    GC9A01_write_byte(0x22);
-    
-    GC9A01_write_command(0xBE);
-    GC9A01_write_byte(0x11);
-    
-    GC9A01_write_command(0xE1);
-    GC9A01_write_byte(0x10);
-    GC9A01_write_byte(0x0E);
-    
-    GC9A01_write_command(0xDF);
-    GC9A01_write_byte(0x21);
-    GC9A01_write_byte(0x0c);
-    GC9A01_write_byte(0x02);
-    
-    GC9A01_write_command(0xF0);
-    GC9A01_write_byte(0x45);
-    GC9A01_write_byte(0x09);
-    GC9A01_write_byte(0x08);
-    GC9A01_write_byte(0x08);
-    GC9A01_write_byte(0x26);
-    GC9A01_write_byte(0x2A);
-    
-    GC9A01_write_command(0xF1);
-    GC9A01_write_byte(0x43);
-    GC9A01_write_byte(0x70);
-    GC9A01_write_byte(0x72);
-    GC9A01_write_byte(0x36);
-    GC9A01_write_byte(0x37);
-    GC9A01_write_byte(0x6F);
-    
-    GC9A01_write_command(0xF2);
-    GC9A01_write_byte(0x45);
-    GC9A01_write_byte(0x09);
-    GC9A01_write_byte(0x08);
-    GC9A01_write_byte(0x08);
-    GC9A01_write_byte(0x26);
-    GC9A01_write_byte(0x2A);
-    
-    GC9A01_write_command(0xF3);
-    GC9A01_write_byte(0x43);
-    GC9A01_write_byte(0x70);
-    GC9A01_write_byte(0x72);
-    GC9A01_write_byte(0x36);
-    GC9A01_write_byte(0x37);
-    GC9A01_write_byte(0x6F);
-    
-    GC9A01_write_command(0xED);
-    GC9A01_write_byte(0x1B);
-    GC9A01_write_byte(0x0B);
-    
-    GC9A01_write_command(0xAE);
-    GC9A01_write_byte(0x77);
-    
-    GC9A01_write_command(0xCD);
-    GC9A01_write_byte(0x63);
-    
-    GC9A01_write_command(0x70);
-    GC9A01_write_byte(0x07);
-    GC9A01_write_byte(0x07);
-    GC9A01_write_byte(0x04);
-    GC9A01_write_byte(0x0E);
-    GC9A01_write_byte(0x0F);
-    GC9A01_write_byte(0x09);
-    GC9A01_write_byte(0x07);
-    GC9A01_write_byte(0x08);
-    GC9A01_write_byte(0x03);
-    
-    GC9A01_write_command(0xE8);
-    GC9A01_write_byte(0x34);
-    
-    GC9A01_write_command(0x62);
-    GC9A01_write_byte(0x18);
-    GC9A01_write_byte(0x0D);
-    GC9A01_write_byte(0x71);
-    GC9A01_write_byte(0xED);
-    GC9A01_write_byte(0x70);
-    GC9A01_write_byte(0x70);
-    GC9A01_write_byte(0x18);
-    GC9A01_write_byte(0x0F);
-    GC9A01_write_byte(0x71);
-    GC9A01_write_byte(0xEF);
-    GC9A01_write_byte(0x70);
-    GC9A01_write_byte(0x70);
-    
-    GC9A01_write_command(0x63);
-    GC9A01_write_byte(0x18);
-    GC9A01_write_byte(0x11);
-    GC9A01_write_byte(0x71);
-    GC9A01_write_byte(0xF1);
-    GC9A01_write_byte(0x70);
-    GC9A01_write_byte(0x70);
-    GC9A01_write_byte(0x18);
-    GC9A01_write_byte(0x13);
-    GC9A01_write_byte(0x71);
-    GC9A01_write_byte(0xF3);
-    GC9A01_write_byte(0x70);
-    GC9A01_write_byte(0x70);
-    
-    GC9A01_write_command(0x64);
-    GC9A01_write_byte(0x28);
-    GC9A01_write_byte(0x29);
-    GC9A01_write_byte(0xF1);
-    GC9A01_write_byte(0x01);
-    GC9A01_write_byte(0xF1);
-    GC9A01_write_byte(0x00);
-    GC9A01_write_byte(0x07);
-    
-    GC9A01_write_command(0x66);
-    GC9A01_write_byte(0x3C);
-    GC9A01_write_byte(0x00);
-    GC9A01_write_byte(0xCD);
-    GC9A01_write_byte(0x67);
-    GC9A01_write_byte(0x45);
-    GC9A01_write_byte(0x45);
-    GC9A01_write_byte(0x10);
-    GC9A01_write_byte(0x00);
-    GC9A01_write_byte(0x00);
-    GC9A01_write_byte(0x00);
-    
-    GC9A01_write_command(0x67);
-    GC9A01_write_byte(0x00);
-    GC9A01_write_byte(0x3C);
-    GC9A01_write_byte(0x00);
-    GC9A01_write_byte(0x00);
-    GC9A01_write_byte(0x00);
-    GC9A01_write_byte(0x01);
-    GC9A01_write_byte(0x54);
-    GC9A01_write_byte(0x10);
-    GC9A01_write_byte(0x32);
-    GC9A01_write_byte(0x98);
-    
-    GC9A01_write_command(0x74);
-    GC9A01_write_byte(0x10);
-    GC9A01_write_byte(0x85);
-    GC9A01_write_byte(0x80);
-    GC9A01_write_byte(0x00);
-    GC9A01_write_byte(0x00);
-    GC9A01_write_byte(0x4E);
-    GC9A01_write_byte(0x00);
-    
-    GC9A01_write_command(0x98);
-    GC9A01_write_byte(0x3e);
-    GC9A01_write_byte(0x07);
-    
-    GC9A01_write_command(0x35);
-    GC9A01_write_command(0x21);
-    
+    clock_gettime(CLOCK_MONOTONIC, &reset_done);
+    usleep(RESET_TO_CMD_US);
+
+    for (size_t i = 0; i < sizeof(init_cmds); ) {
+        uint8_t cmd = init_cmds[i];
+        uint8_t len = init_cmds[i + 1];
+        GC9A01_write_command(cmd);
+        if (len) {
+            GC9A01_write_data((uint8_t *)&init_cmds[i + 2], len);
+        }
+        i += 2 + len;
+    }
+
+    //the table usually streams out well inside the Sleep Out lockout; wait out the rest
+    uint64_t since_reset = elapsed_us(&reset_done);
+    if (since_reset < RESET_TO_SLPOUT_US) {
+        usleep((useconds_t)(RESET_TO_SLPOUT_US - since_reset));
+    }
     GC9A01_write_command(0x11);
-    usleep(120000);
+    usleep(SLPOUT_TO_CMD_US);
+    GC9A01_write_command(MADCTL);
+    GC9A01_write_byte(madctl);
     GC9A01_write_command(0x29);
-    usleep(20000);
-    
+
+    return 0;
+}
+
+//skip reset and the init table when the panel is already awake and configured,
+//e.g. after restarting the daemon. Needs MISO; returns -1 when a cold init is required.
+int GC9A01_init_warm(void) {
+    uint8_t power_mode = GC9A01_read_reg8(READ_POWER_MODE);
+    uint8_t colmod = GC9A01_read_reg8(READ_COLMOD);
+
+    if ((power_mode & (POWER_MODE_SLEEP_OUT | POWER_MODE_DISPLAY_ON)) !=
+            (POWER_MODE_SLEEP_OUT | POWER_MODE_DISPLAY_ON) ||
+        (colmod & 0x07) != COLOR_MODE__16_BIT) {
+        return -1;
+    }
+    //the previous run may have used another orientation; rewriting is cheaper than reading
+    GC9A01_write_command(MADCTL);
+    GC9A01_write_byte(madctl);
+    //a previous run may have left the panel scrolled; scroll state can't be read back
+    GC9A01_set_scroll_area(0, 240, 0);
+    GC9A01_set_scroll_start(0);
+    return 0;
+}
+
+//rotation in clockwise quarter turns; mirroring is applied in framebuffer axes
+int GC9A01_set_orientation(int rotation, int mirror_x, int mirror_y) {
+    if (rotation < 0 || rotation > 3) {
+        return -1;
+    }
+    madctl = MADCTL_BGR | madctl_rotation[rotation];
+    if (mirror_x) madctl ^= MADCTL_MX;
+    if (mirror_y) madctl ^= MADCTL_MY;
+    orientation[0] = rotation;
+    orientation[1] = !!mirror_x;
+    orientation[2] = !!mirror_y;
+    GC9A01_write_command(MADCTL);
+    GC9A01_write_byte(madctl);
     return 0;
 }
 
+void GC9A01_get_orientation(int *rotation, int *mirror_x, int *mirror_y) {
+    *rotation = orientation[0];
+    *mirror_x = orientation[1];
+    *mirror_y = orientation[2];
+}
+
+uint8_t GC9A01_get_madctl(void) {
+    return madctl;
+}
+
+//vertical scroll works on gate lines, whatever MADCTL does to the address counters
+void GC9A01_set_scroll_area(uint16_t top_fixed, uint16_t scroll_lines, uint16_t bottom_fixed) {
+    uint8_t data[6] = {
+        (uint8_t)(top_fixed >> 8), (uint8_t)(top_fixed & 0xFF),
+        (uint8_t)(scroll_lines >> 8), (uint8_t)(scroll_lines & 0xFF),
+        (uint8_t)(bottom_fixed >> 8), (uint8_t)(bottom_fixed & 0xFF),
+    };
+    GC9A01_write_command(VSCROLL_DEF);
+    GC9A01_write_data(data, sizeof(data));
+}
+
+void GC9A01_set_scroll_start(uint16_t line) {
+    uint8_t data[2] = { (uint8_t)(line >> 8), (uint8_t)(line & 0xFF) };
+    GC9A01_write_command(VSCROLL_START);
+    GC9A01_write_data(data, sizeof(data));
+}
+
 void GC9A01_set_frame(struct GC9A01_frame frame) {
 
     uint8_t data[4];
@@ -338,6 +282,19 @@ void GC9A01_display_on(uint8_t on){
     }
 }
 
+//read the 24 bit display ID, needs MISO wired. Reads 32 bits since
+//spidev can't clock the single dummy bit on its own, then drops it.
+uint32_t GC9A01_read_id(void) {
+    uint8_t rx[4] = {0};
+
+    GC9A01_write_command(READ_ID);
+    GC9A01_set_data_command(1);
+    GC9A01_spi_rx(rx, sizeof(rx));
+
+    uint32_t raw = ((uint32_t)rx[0] << 24) | ((uint32_t)rx[1] << 16) | ((uint32_t)rx[2] << 8) | rx[3];
+    return (raw >> 7) & 0xFFFFFF;
+}
+
 // 0b0XXX0101 to set 16 bit color mode command 0x3A
 
 void GC9A01_set_color_mode_16bit(){
@@ -13,9 +13,33 @@ extern "C" {
 void GC9A01_set_reset(uint8_t val);
 void GC9A01_set_data_command(uint8_t val);
 void GC9A01_spi_tx(uint8_t *data, size_t len);
+void GC9A01_spi_rx(uint8_t *data, size_t len);
+int GC9A01_spi_set_speed(uint32_t speed_hz);
+uint32_t GC9A01_spi_get_speed(void);
+size_t GC9A01_spi_max_transfer(void);            // spidev bufsiz: upper bound for one message
+int GC9A01_spi_set_xfer_size(size_t bytes);        // size of each transfer inside a message
+size_t GC9A01_spi_get_xfer_size(void);
 int setup_2gpio(char *chipname, int line_1, int line_2);
 void close_gpio();
-void setup();
+/* Tearing-effect output (enabled by the 0x35 TEON in the init sequence):
+ * one rising edge per panel refresh, at the start of vertical blanking.
+ * The spidev backend reads it from a GPIO line; the virtual backend fakes
+ * a 60 Hz edge train. te_wait returns 1 on an edge, 0 on timeout, -1 on error. */
+int GC9A01_te_open(int line);
+int GC9A01_te_wait(int timeout_ms);
+void GC9A01_te_close(void);
+void setup(int allow_warm);
+
+// Transfer counters kept by the HAL backend (gc9a01_spidev.c or gc9a01_virtual.c)
+struct GC9A01_hal_stats {
+    uint64_t syscalls;      // SPI ioctls issued (modelled on the virtual backend)
+    uint64_t dc_toggles;    // D/C line level changes
+    uint64_t bytes;         // bytes clocked out on MOSI
+    uint64_t transfer_ns;   // time spent in SPI transfers (modelled on the virtual backend)
+};
+
+void GC9A01_get_hal_stats(struct GC9A01_hal_stats *stats);
+void GC9A01_reset_hal_stats(void);
 
 
 struct GC9A01_point {
@@ -27,13 +51,21 @@ struct GC9A01_frame {
 };
 
 int spi_init(void);
+void spi_close(void);
 int GC9A01_init(void);
+int GC9A01_init_warm(void);
 void GC9A01_set_frame(struct GC9A01_frame frame);
 void GC9A01_write(uint8_t *data, size_t len);
 void GC9A01_write_continue(uint8_t *data, size_t len);
 void GC9A01_invert_display(uint8_t invert);
 void GC9A01_sleep(uint8_t sleep);
 void GC9A01_display_on(uint8_t on);
+uint32_t GC9A01_read_id(void);
+int GC9A01_set_orientation(int rotation, int mirror_x, int mirror_y); // rotation 0-3, clockwise quarter turns
+void GC9A01_get_orientation(int *rotation, int *mirror_x, int *mirror_y);
+uint8_t GC9A01_get_madctl(void);                  // MADCTL value currently programmed
+void GC9A01_set_scroll_area(uint16_t top_fixed, uint16_t scroll_lines, uint16_t bottom_fixed);
+void GC9A01_set_scroll_start(uint16_t line);
 
 #ifdef __cplusplus
 }
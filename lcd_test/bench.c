@@ -0,0 +1,517 @@
+/* Render/flush benchmarks: each case renders and flushes a number of
+frames, then reports wall time and HAL transfer counters per frame */
+
+#include "bench.h"
+#include "GC9A01.h"
+#include "framebuffer.h"
+#include "startscreen.h"
+#include "flush_thread.h"
+#include "splash.h"
+#include "glyph_cache.h"
+#include "color_utils.h"
+#include "buffer_pool.h"
+#include "compositor.h"
+#include "frame_sched.h"
+#include "widget.h"
+#include "font_atlas.h"
+#include "socket_rx.h"
+#ifdef GC9A01_BACKEND_VIRTUAL
+#include "gc9a01_virtual.h"
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+static const struct GC9A01_frame full_frame = {{0,0},{239,239}};
+static const struct GC9A01_frame text_frame = {{30, 45},{210, 195}};
+static int bench_failed = 0; //a case couldn't exercise what it measures
+
+struct bench_case {
+    const char *name;
+    int frames;
+    void (*prepare)(uint8_t *framebuffer);
+    void (*frame)(uint8_t *framebuffer, int i);
+    void (*finish)(void);
+};
+
+static uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void prepare_text(uint8_t *framebuffer) {
+    struct fb_damage discard;
+    textbuffer_initialize();
+    fb_clear(framebuffer);
+    //like text_append, leave the panel outside the text area alone
+    fb_damage_take(&discard);
+}
+
+static void frame_splash(uint8_t *framebuffer, int i) {
+    (void)i;
+    draw_startup_screen(framebuffer);
+    fb_shadow_invalidate(); //time the full transfer, not an empty diff
+    fb_write_to_gc9a01_fast(framebuffer, full_frame);
+}
+
+static void prepare_disc(uint8_t *framebuffer) {
+    (void)framebuffer;
+    fb_set_disc_clip(1);
+}
+
+static void finish_disc(void) {
+    fb_set_disc_clip(0);
+}
+
+static void frame_text(uint8_t *framebuffer, int i) {
+    static const char *words[] = { "live", "translation", "of", "a", "sentence,", "word", "by", "word" };
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%s", words[i % 8]);
+    fb_receive_and_update_text(framebuffer, buffer);
+    textbuffer_render(framebuffer);
+    fb_write_to_gc9a01_fast(framebuffer, text_frame);
+}
+
+//same stream as frame_text, but only the damaged regions go out
+static void frame_text_damage(uint8_t *framebuffer, int i) {
+    static const char *words[] = { "live", "translation", "of", "a", "sentence,", "word", "by", "word" };
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%s", words[i % 8]);
+    fb_receive_and_update_text(framebuffer, buffer);
+    textbuffer_render(framebuffer);
+    fb_flush_damage(framebuffer);
+}
+
+//text_damage's stream arriving as one burst: the scheduler folds it into a couple of frames,
+//which the flush thread starts on TE edges
+static uint8_t *burst_fb;
+static struct flush_stats burst_flush;
+
+static void burst_submit(uint8_t *framebuffer) {
+    struct fb_damage damage;
+    textbuffer_render(framebuffer);
+    fb_damage_take(&damage);
+    flush_submit_damage(framebuffer, &damage);
+}
+
+static void prepare_text_burst(uint8_t *framebuffer) {
+    prepare_text(framebuffer);
+    burst_fb = framebuffer;
+    frame_sched_init(60);
+    frame_sched_reset_stats();
+#ifdef GC9A01_BACKEND_VIRTUAL
+    flush_thread_start(0); //fake TE edges
+#else
+    flush_thread_start(-1);
+#endif
+    flush_get_stats(&burst_flush);
+}
+
+static void frame_text_burst(uint8_t *framebuffer, int i) {
+    static const char *words[] = { "live", "translation", "of", "a", "sentence,", "word", "by", "word" };
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%s", words[i % 8]);
+    fb_receive_and_update_text(framebuffer, buffer);
+    frame_sched_mark();
+    if (frame_sched_begin()) {
+        burst_submit(framebuffer);
+    }
+}
+
+static void finish_text_burst(void) {
+    struct frame_sched_stats fs;
+    struct flush_stats flush;
+    int wait;
+    //let the last coalesced frame out
+    while ((wait = frame_sched_timeout_ms(-1)) >= 0) {
+        struct timespec d = { 0, (long)wait * 1000000L };
+        nanosleep(&d, NULL);
+        if (frame_sched_begin()) {
+            burst_submit(burst_fb);
+        }
+    }
+    flush_wait_idle();
+    flush_thread_stop();
+    frame_sched_get_stats(&fs);
+    flush_get_stats(&flush);
+    printf("bench text_burst: %llu updates in %llu frames, %llu sent, %llu started on TE\n",
+           (unsigned long long)fs.updates, (unsigned long long)fs.frames,
+           (unsigned long long)(flush.flushed - burst_flush.flushed),
+           (unsigned long long)(flush.te_edges - burst_flush.te_edges));
+}
+
+//text_layout: multi-kilobyte datagrams with long words, newlines and UTF-8, laid out then rendered once
+#define LAYOUT_INPUT_BYTES 4096
+static char layout_input[LAYOUT_INPUT_BYTES + 1];
+static uint64_t layout_ns, layout_bytes, layout_frames;
+
+static void prepare_text_layout(uint8_t *framebuffer) {
+    static const char *words[] = { "live", "translation", "of", "a", "sentence,", "caf\xc3\xa9",
+                                   "internationalization-and-localization", "word", "by", "word\n" };
+    size_t len = 0;
+    for (int i = 0; ; i++) {
+        const char *w = words[(i * 7) % 10];
+        size_t n = strlen(w);
+        if (len + n + 1 > LAYOUT_INPUT_BYTES) {
+            break;
+        }
+        memcpy(&layout_input[len], w, n);
+        len += n;
+        layout_input[len++] = ' ';
+    }
+    layout_input[len] = '\0';
+    layout_ns = 0;
+    layout_bytes = 0;
+    layout_frames = 0;
+    prepare_text(framebuffer);
+}
+
+static void frame_text_layout(uint8_t *framebuffer, int i) {
+    //a different cut each frame, so the rows on screen change (and sequences split across writes)
+    size_t len = strlen(layout_input) - (size_t)(i * 61) % 512;
+    uint64_t t0 = bench_now_ns();
+    textbuffer_write(layout_input, len);
+    layout_ns += bench_now_ns() - t0;
+    layout_bytes += len;
+    layout_frames++;
+    textbuffer_render(framebuffer);
+    fb_flush_damage(framebuffer);
+}
+
+static void finish_text_layout(void) {
+    printf("bench text_layout: %.1f MB/s laid out (%.0f bytes per frame)\n",
+           layout_bytes * 1000.0 / (double)layout_ns, layout_bytes / (double)layout_frames);
+}
+
+//socket_burst: a translator burst queued on a datagram socket, drained in one go, then one render
+#define BURST_DATAGRAMS 25
+static int burst_sock[2] = { -1, -1 };
+static struct socket_rx_stats burst_rx;
+
+static void on_burst_datagram(void *ctx, char *data, size_t len) {
+    (void)len;
+    fb_receive_and_update_text(ctx, data);
+}
+
+static void prepare_socket_burst(uint8_t *framebuffer) {
+    prepare_text(framebuffer);
+    if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0, burst_sock) != 0) {
+        perror("socketpair");
+    }
+    socket_rx_get_stats(&burst_rx);
+}
+
+static void frame_socket_burst(uint8_t *framebuffer, int i) {
+    static const char *words[] = { "live", "translation", "of", "a", "sentence,", "word", "by", "word" };
+    for (int d = 0; d < BURST_DATAGRAMS; d++) {
+        const char *w = words[(i + d) % 8];
+        if (send(burst_sock[1], w, strlen(w), 0) < 0) {
+            perror("send");
+        }
+    }
+    receive_batch(burst_sock[0], on_burst_datagram, framebuffer);
+    textbuffer_render(framebuffer);
+    fb_flush_damage(framebuffer);
+}
+
+static void finish_socket_burst(void) {
+    struct socket_rx_stats rx;
+    socket_rx_get_stats(&rx);
+    close(burst_sock[0]);
+    close(burst_sock[1]);
+    printf("bench socket_burst: %llu datagrams in %llu recvmmsg calls, %llu coalesced, %llu dropped\n",
+           (unsigned long long)(rx.received - burst_rx.received), (unsigned long long)(rx.syscalls - burst_rx.syscalls),
+           (unsigned long long)(rx.coalesced - burst_rx.coalesced), (unsigned long long)(rx.dropped - burst_rx.dropped));
+}
+
+//widgets: console text every frame, battery gauge every fifth, each in its own layer
+static struct widget *bench_console, *bench_battery;
+
+static void prepare_widgets(uint8_t *framebuffer) {
+    const struct GC9A01_frame console_frame = {{30, 45},{210, 195}};
+    const struct GC9A01_frame battery_frame = {{214, 110},{234, 130}};
+    prepare_text(framebuffer);
+    widget_reset();
+    bench_console = widget_add_console(console_frame);
+    bench_battery = widget_add_battery(battery_frame, NULL);
+    widget_layers_create(); //as the daemon draws them
+}
+
+static void frame_widgets(uint8_t *framebuffer, int i) {
+    static const char *words[] = { "live", "translation", "of", "a", "sentence,", "word", "by", "word" };
+    struct fb_damage damage;
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%s", words[i % 8]);
+    fb_receive_and_update_text(framebuffer, buffer);
+    widget_invalidate(bench_console);
+    if (i % 5 == 0) {
+        widget_battery_set_level(bench_battery, 100 - i * 2);
+    }
+    widget_refresh(framebuffer, &damage);
+    fb_flush_damage_list(framebuffer, &damage);
+}
+
+static void finish_widgets(void) {
+    widget_reset();
+    comp_destroy();
+}
+
+//text_scroll: hardware scroll needs rotation 0, so the case switches to it and back
+static int scroll_rotation, scroll_mirror_x, scroll_mirror_y;
+
+static void prepare_text_scroll(uint8_t *framebuffer) {
+    GC9A01_get_orientation(&scroll_rotation, &scroll_mirror_x, &scroll_mirror_y);
+    GC9A01_set_orientation(0, 0, 0);
+    fb_shadow_invalidate(); //panel RAM was written in the other orientation
+    prepare_text(framebuffer);
+    if (textbuffer_set_hw_scroll(1) != 0) {
+        printf("bench: text_scroll FAILED, hardware scroll refused at rotation 0\n");
+        bench_failed = 1;
+    }
+}
+
+static void finish_text_scroll(void) {
+    textbuffer_set_hw_scroll(0);
+    GC9A01_set_orientation(scroll_rotation, scroll_mirror_x, scroll_mirror_y);
+    fb_shadow_invalidate();
+}
+
+static void frame_splash_asset(uint8_t *framebuffer, int i) {
+    (void)framebuffer;
+    if (splash_show(SPLASH_PATH) != 0 && i == 0) {
+        printf("bench: %s missing, run make splash\n", SPLASH_PATH);
+    }
+}
+
+static void prepare_text_async(uint8_t *framebuffer) {
+    prepare_text(framebuffer);
+    flush_thread_start(-1);
+}
+
+static void frame_text_async(uint8_t *framebuffer, int i) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "word%d", i);
+    fb_receive_and_update_text(framebuffer, buffer);
+    textbuffer_render(framebuffer);
+    struct fb_damage damage;
+    fb_damage_take(&damage);
+    flush_submit_damage(framebuffer, &damage);
+}
+
+static void finish_async(void) {
+    flush_wait_idle();
+    flush_thread_stop();
+}
+
+//composite: background, keyed text and a translucent SoC overlay, updated in turn
+static const struct GC9A01_frame soc_frame = {{195, 110},{215, 130}};
+static struct comp_layer *text_layer, *soc_layer;
+static uint8_t *comp_out;
+
+static void prepare_composite(uint8_t *framebuffer) {
+    struct fb_damage discard;
+    struct comp_layer *bg = comp_layer_create(full_frame, 255, COMP_NO_KEY);
+    text_layer = comp_layer_create(text_frame, 255, GLYPH_RGB(0, 0, 0));
+    soc_layer = comp_layer_create(soc_frame, 192, COMP_NO_KEY);
+    comp_out = framebuffer;
+    if (!bg || !text_layer || !soc_layer) {
+        return;
+    }
+    draw_startup_screen(comp_layer_pixels(bg));
+    textbuffer_initialize();
+    fb_clear(framebuffer);
+    fb_damage_take(&discard);
+    //the first composite rebuilds every tile
+    comp_composite(framebuffer);
+    fb_flush_damage(framebuffer);
+    comp_reset_stats();
+}
+
+static void frame_composite(uint8_t *framebuffer, int i) {
+    if (!text_layer || !soc_layer) {
+        return;
+    }
+    if (i % 2 == 0) {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "layer%d", i);
+        fb_receive_and_update_text(comp_layer_pixels(text_layer), buffer);
+        textbuffer_render(comp_layer_pixels(text_layer));
+        comp_layer_commit(text_layer);
+    } else {
+        //battery level bar: filled up to (i % 21) pixels from the bottom
+        uint8_t *px = comp_layer_pixels(soc_layer);
+        int level = i % 21;
+        for (int y = soc_frame.start.Y; y <= soc_frame.end.Y; y++) {
+            int on = soc_frame.end.Y - y < level;
+            for (int x = soc_frame.start.X; x <= soc_frame.end.X; x++) {
+                fb_set_pixel(px, x, y, on ? 0 : 64, on ? 200 : 64, on ? 255 : 64);
+            }
+        }
+        fb_damage_mark(soc_frame.start.X, soc_frame.start.Y, 21, 21);
+        comp_layer_commit(soc_layer);
+    }
+    comp_composite(framebuffer);
+    fb_flush_damage(framebuffer);
+}
+
+static void finish_composite(void) {
+    struct comp_stats cs;
+    //hide the overlays again: the panel is back to the plain splash for the cases after
+    if (text_layer && soc_layer) {
+        comp_layer_set_visible(text_layer, 0);
+        comp_layer_set_visible(soc_layer, 0);
+        comp_composite(comp_out);
+        fb_flush_damage(comp_out);
+    }
+    comp_get_stats(&cs);
+    printf("bench composite: %.1f tiles and %.1f layer blits per frame\n",
+           cs.tiles / (double)cs.composites, cs.layer_blits / (double)cs.composites);
+    comp_destroy();
+}
+
+static const struct bench_case cases[] = {
+    //first: the splash cases paint over the battery gauge it leaves behind
+    { "widgets", 40, prepare_widgets, frame_widgets, finish_widgets },
+    { "splash_full", 20, NULL, frame_splash, NULL },
+    { "splash_disc", 20, prepare_disc, frame_splash, finish_disc },
+    { "splash_asset", 20, NULL, frame_splash_asset, NULL },
+    { "composite", 40, prepare_composite, frame_composite, finish_composite },
+    { "text_append", 40, prepare_text, frame_text, NULL },
+    { "text_damage", 40, prepare_text, frame_text_damage, NULL },
+    { "text_async", 40, prepare_text_async, frame_text_async, finish_async },
+    { "text_burst", 40, prepare_text_burst, frame_text_burst, finish_text_burst },
+    { "text_layout", 40, prepare_text_layout, frame_text_layout, finish_text_layout },
+    { "socket_burst", 40, prepare_socket_burst, frame_socket_burst, finish_socket_burst },
+    //last: leaves the rotation-0 text on the panel
+    { "text_scroll", 40, prepare_text_scroll, frame_text_damage, finish_text_scroll },
+};
+
+static void bench_case_run(const struct bench_case *bc, uint8_t *framebuffer) {
+    struct GC9A01_hal_stats hs;
+    struct buffer_pool_stats ps;
+    struct fb_shadow_stats ss;
+
+    if (bc->prepare) {
+        bc->prepare(framebuffer);
+    }
+    GC9A01_reset_hal_stats();
+    buffer_pool_reset_stats(); //setup may borrow; only the frame loop must stay off the heap
+    fb_reset_shadow_stats();
+    uint64_t t0 = bench_now_ns();
+    for (int i = 0; i < bc->frames; i++) {
+        bc->frame(framebuffer, i);
+    }
+    if (bc->finish) {
+        bc->finish();
+    }
+    uint64_t wall_ns = bench_now_ns() - t0;
+    GC9A01_get_hal_stats(&hs);
+    buffer_pool_get_stats(&ps);
+    fb_get_shadow_stats(&ss);
+
+    double n = (double)bc->frames;
+    printf("bench %-14s %4d frames  wall %9.1f us  syscalls %7.1f  dc %7.1f  bytes %9.0f  spi %9.1f us  heap %llu",
+           bc->name, bc->frames, wall_ns / n / 1000.0, hs.syscalls / n,
+           hs.dc_toggles / n, hs.bytes / n, hs.transfer_ns / n / 1000.0,
+           (unsigned long long)ps.heap_allocs);
+#ifdef GC9A01_BACKEND_VIRTUAL
+    printf("  crc %08x", vpanel_checksum());
+#endif
+    printf("\n");
+    if (ss.requested_px) {
+        printf("bench %-14s shadow diff: %.1f%% of %.0f px sent in %.1f windows per frame",
+               bc->name, 100.0 * ss.sent_px / ss.requested_px, ss.requested_px / n, ss.windows / n);
+        if (ss.disc_skipped_px) {
+            printf(", %.0f bytes saved outside the disc", ss.disc_skipped_px * 2 / n);
+        }
+        printf("\n");
+    }
+}
+
+#define KERNEL_PIXELS (FB_WIDTH * FB_HEIGHT)
+#define KERNEL_REPS 200
+
+//pixels/second for every supported span kernel, checked bit-exact against scalar
+static void bench_color_kernels(void) {
+    size_t nk;
+    const struct color_span_kernel *k = color_span_kernels(&nk);
+    uint8_t *rgb = malloc(KERNEL_PIXELS * 3);
+    uint8_t *ref = malloc(KERNEL_PIXELS * 2);
+    uint8_t *out = malloc(KERNEL_PIXELS * 2);
+    if (!rgb || !ref || !out) {
+        perror("malloc kernel buffers");
+        goto out;
+    }
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < KERNEL_PIXELS * 3; i++) {
+        seed = seed * 1103515245u + 12345u;
+        rgb[i] = (uint8_t)(seed >> 16);
+    }
+
+    for (size_t v = 0; v < nk; v++) {
+        if (!k[v].supported()) {
+            printf("bench kernel %-8s unsupported on this CPU\n", k[v].name);
+            continue;
+        }
+        //odd lengths exercise the scalar tails
+        int exact = 1;
+        for (size_t n = KERNEL_PIXELS - 33; n <= KERNEL_PIXELS; n += 11) {
+            size_t a = k[0].rgb565(rgb, ref, n), b = k[v].rgb565(rgb, out, n);
+            exact &= a == b && memcmp(ref, out, a) == 0;
+            a = k[0].rgb444(rgb, ref, n);
+            b = k[v].rgb444(rgb, out, n);
+            exact &= a == b && memcmp(ref, out, a) == 0;
+        }
+
+        double mpx[2];
+        color_span_fn fns[2] = { k[v].rgb565, k[v].rgb444 };
+        for (int f = 0; f < 2; f++) {
+            uint64_t t0 = bench_now_ns();
+            for (int rep = 0; rep < KERNEL_REPS; rep++) {
+                fns[f](rgb, out, KERNEL_PIXELS);
+            }
+            mpx[f] = (double)KERNEL_PIXELS * KERNEL_REPS * 1000.0 / (double)(bench_now_ns() - t0);
+        }
+        printf("bench kernel %-8s rgb565 %8.1f Mpx/s  rgb444 %8.1f Mpx/s  %s%s\n", k[v].name, mpx[0], mpx[1],
+               exact ? "bit-exact" : "MISMATCH", strcmp(k[v].name, color_span_active()) ? "" : "  (active)");
+    }
+out:
+    free(rgb);
+    free(ref);
+    free(out);
+}
+
+int bench_run(void) {
+    uint8_t *framebuffer = malloc(FB_SIZE);
+    if (!framebuffer) {
+        perror("malloc framebuffer");
+        return -1;
+    }
+
+    struct glyph_cache_stats gs;
+    glyph_cache_reset_stats();
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        bench_case_run(&cases[i], framebuffer);
+    }
+    bench_color_kernels();
+    glyph_cache_get_stats(&gs);
+    printf("bench glyph cache: %llu hits, %llu misses, %llu evictions\n",
+           (unsigned long long)gs.hits, (unsigned long long)gs.misses,
+           (unsigned long long)gs.evictions);
+    struct font_atlas_stats as;
+    font_atlas_get_stats(&as);
+    if (as.mapped_bytes) {
+        printf("bench font atlas: %zu KB mapped, %zu KB resident, %llu blocks touched, %llu/%llu lookups fell back\n",
+               as.mapped_bytes / 1024, as.resident_bytes / 1024, (unsigned long long)as.blocks_touched,
+               (unsigned long long)as.fallbacks, (unsigned long long)as.lookups);
+    }
+
+    free(framebuffer);
+    return bench_failed ? -1 : 0;
+}
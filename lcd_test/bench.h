@@ -0,0 +1,9 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/* Render/flush benchmarks. Run with `lcd_test --bench`; on the virtual
+ * backend the SPI figures are modelled and a panel checksum is printed
+ * for golden-image comparison. */
+int bench_run(void);
+
+#endif //BENCH_H
@@ -0,0 +1,97 @@
+/* preallocated packed-frame buffers, so flushes never touch the heap */
+
+#include "buffer_pool.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static uint8_t *pool_mem = NULL;
+static int pool_free[POOL_BUFFERS]; //stack of free buffer indices
+static int pool_nfree = 0;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct buffer_pool_stats stats;
+
+int buffer_pool_init(void) {
+    if (pool_mem) {
+        return 0;
+    }
+    //POOL_BUF_BYTES is a multiple of POOL_ALIGN, so every buffer stays aligned
+    pool_mem = aligned_alloc(POOL_ALIGN, (size_t)POOL_BUFFERS * POOL_BUF_BYTES);
+    if (!pool_mem) {
+        perror("aligned_alloc buffer pool");
+        return -1;
+    }
+    pthread_mutex_lock(&pool_lock);
+    for (int i = 0; i < POOL_BUFFERS; i++) {
+        pool_free[i] = POOL_BUFFERS - 1 - i;
+    }
+    pool_nfree = POOL_BUFFERS;
+    pthread_mutex_unlock(&pool_lock);
+    return 0;
+}
+
+//all buffers must have been returned
+void buffer_pool_destroy(void) {
+    pthread_mutex_lock(&pool_lock);
+    if (stats.in_use) {
+        fprintf(stderr, "buffer pool destroyed with %d buffers borrowed\n", stats.in_use);
+    }
+    free(pool_mem);
+    pool_mem = NULL;
+    pool_nfree = 0;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+uint8_t *buffer_pool_get(size_t bytes) {
+    uint8_t *buf = NULL;
+
+    pthread_mutex_lock(&pool_lock);
+    stats.borrows++;
+    if (bytes <= POOL_BUF_BYTES && pool_nfree > 0) {
+        buf = pool_mem + (size_t)pool_free[--pool_nfree] * POOL_BUF_BYTES;
+        if (++stats.in_use > stats.peak) {
+            stats.peak = stats.in_use;
+        }
+    } else {
+        stats.heap_allocs++;
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    if (!buf) {
+        buf = malloc(bytes);
+        if (!buf) {
+            perror("malloc pool fallback");
+        }
+    }
+    return buf;
+}
+
+void buffer_pool_put(uint8_t *buf) {
+    if (!buf) {
+        return;
+    }
+    if (!pool_mem || buf < pool_mem || buf >= pool_mem + (size_t)POOL_BUFFERS * POOL_BUF_BYTES) {
+        free(buf); //heap fallback
+        return;
+    }
+    pthread_mutex_lock(&pool_lock);
+    pool_free[pool_nfree++] = (int)((size_t)(buf - pool_mem) / POOL_BUF_BYTES);
+    stats.in_use--;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+void buffer_pool_get_stats(struct buffer_pool_stats *out) {
+    pthread_mutex_lock(&pool_lock);
+    *out = stats;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+//clears the counters, keeps track of what is still borrowed
+void buffer_pool_reset_stats(void) {
+    pthread_mutex_lock(&pool_lock);
+    stats.borrows = 0;
+    stats.heap_allocs = 0;
+    stats.peak = stats.in_use;
+    pthread_mutex_unlock(&pool_lock);
+}
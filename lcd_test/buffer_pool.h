@@ -0,0 +1,32 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Packed-frame buffer pool: a few cache-line aligned buffers, each big
+ * enough for a full RGB565 frame, allocated once at startup. Flushes
+ * borrow and return them instead of going to the heap; a request the
+ * pool can't serve falls back to malloc and shows up in heap_allocs,
+ * which stays at zero in steady state.
+ */
+
+#define POOL_BUF_BYTES (240 * 240 * 2) //largest packed frame, RGB565
+#define POOL_BUFFERS 3                 //one synchronous flush + two flush-thread slots
+#define POOL_ALIGN 64
+
+struct buffer_pool_stats {
+    uint64_t borrows;       // buffer_pool_get calls
+    uint64_t heap_allocs;   // fallbacks to malloc (pool empty, too small or not initialised)
+    int in_use;             // pool buffers currently borrowed
+    int peak;               // most pool buffers borrowed at once
+};
+
+int buffer_pool_init(void);
+void buffer_pool_destroy(void);
+uint8_t *buffer_pool_get(size_t bytes);
+void buffer_pool_put(uint8_t *buf);
+void buffer_pool_get_stats(struct buffer_pool_stats *stats);
+void buffer_pool_reset_stats(void);
+
+#endif //BUFFER_POOL_H
@@ -21,4 +21,261 @@ struct GC9A01_color rgb_to_18bit(uint8_t r, uint8_t g, uint8_t b) {
     color.bytes[1] = g & 0xFC;
     color.bytes[2] = b & 0xFC;
     return color;
-}
\ No newline at end of file
+}
+/* Span kernels */
+
+static size_t span_rgb565_scalar(const uint8_t *rgb, uint8_t *out, size_t n) {
+    for (size_t i = 0; i < n; i++, rgb += 3) {
+        out[2 * i] = (uint8_t)((rgb[0] & 0xF8) | (rgb[1] >> 5));
+        out[2 * i + 1] = (uint8_t)(((rgb[1] << 3) & 0xE0) | (rgb[2] >> 3));
+    }
+    return n * 2;
+}
+
+static size_t span_rgb444_scalar(const uint8_t *rgb, uint8_t *out, size_t n) {
+    size_t o = 0;
+    for (; n >= 2; n -= 2, rgb += 6) {
+        out[o++] = (uint8_t)((rgb[0] & 0xF0) | (rgb[1] >> 4));
+        out[o++] = (uint8_t)((rgb[2] & 0xF0) | (rgb[3] >> 4));
+        out[o++] = (uint8_t)((rgb[4] & 0xF0) | (rgb[5] >> 4));
+    }
+    if (n) {
+        struct GC9A01_color c = rgb_to_12bit(rgb[0], rgb[1], rgb[2]);
+        out[o++] = c.bytes[0];
+        out[o++] = c.bytes[1];
+    }
+    return o;
+}
+
+static int span_always(void) {
+    return 1;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+#define Z -1 //pshufb: zero this byte
+
+//RGB888 -> one channel per register, 16 pixels from 48 bytes (p0..p2)
+#define DEINTERLEAVE_MASKS \
+    const __m128i r0 = _mm_setr_epi8(0, 3, 6, 9, 12, 15, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z); \
+    const __m128i r1 = _mm_setr_epi8(Z, Z, Z, Z, Z, Z, 2, 5, 8, 11, 14, Z, Z, Z, Z, Z); \
+    const __m128i r2 = _mm_setr_epi8(Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, 1, 4, 7, 10, 13); \
+    const __m128i g0 = _mm_setr_epi8(1, 4, 7, 10, 13, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z); \
+    const __m128i g1 = _mm_setr_epi8(Z, Z, Z, Z, Z, 0, 3, 6, 9, 12, 15, Z, Z, Z, Z, Z); \
+    const __m128i g2 = _mm_setr_epi8(Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, 2, 5, 8, 11, 14); \
+    const __m128i b0 = _mm_setr_epi8(2, 5, 8, 11, 14, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z); \
+    const __m128i b1 = _mm_setr_epi8(Z, Z, Z, Z, Z, 1, 4, 7, 10, 13, Z, Z, Z, Z, Z, Z); \
+    const __m128i b2 = _mm_setr_epi8(Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, 0, 3, 6, 9, 12, 15)
+
+//12-bit stream: byte 3k from E[2k], 3k+1 from F[2k], 3k+2 from H[2k+1]
+#define PACK444_MASKS \
+    const __m128i e0 = _mm_setr_epi8(0, Z, Z, 2, Z, Z, 4, Z, Z, 6, Z, Z, 8, Z, Z, 10); \
+    const __m128i f0 = _mm_setr_epi8(Z, 0, Z, Z, 2, Z, Z, 4, Z, Z, 6, Z, Z, 8, Z, Z); \
+    const __m128i h0 = _mm_setr_epi8(Z, Z, 1, Z, Z, 3, Z, Z, 5, Z, Z, 7, Z, Z, 9, Z); \
+    const __m128i e1 = _mm_setr_epi8(Z, Z, 12, Z, Z, 14, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z); \
+    const __m128i f1 = _mm_setr_epi8(10, Z, Z, 12, Z, Z, 14, Z, Z, Z, Z, Z, Z, Z, Z, Z); \
+    const __m128i h1 = _mm_setr_epi8(Z, 11, Z, Z, 13, Z, Z, 15, Z, Z, Z, Z, Z, Z, Z, Z)
+
+__attribute__((target("ssse3")))
+static inline void deinterleave_ssse3(const uint8_t *rgb, __m128i *r, __m128i *g, __m128i *b) {
+    DEINTERLEAVE_MASKS;
+    __m128i p0 = _mm_loadu_si128((const __m128i *)rgb);
+    __m128i p1 = _mm_loadu_si128((const __m128i *)(rgb + 16));
+    __m128i p2 = _mm_loadu_si128((const __m128i *)(rgb + 32));
+    *r = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(p0, r0), _mm_shuffle_epi8(p1, r1)), _mm_shuffle_epi8(p2, r2));
+    *g = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(p0, g0), _mm_shuffle_epi8(p1, g1)), _mm_shuffle_epi8(p2, g2));
+    *b = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(p0, b0), _mm_shuffle_epi8(p1, b1)), _mm_shuffle_epi8(p2, b2));
+}
+
+__attribute__((target("ssse3")))
+static size_t span_rgb565_ssse3(const uint8_t *rgb, uint8_t *out, size_t n) {
+    const __m128i m_f8 = _mm_set1_epi8((char)0xF8);
+    const __m128i m_e0 = _mm_set1_epi8((char)0xE0);
+    const __m128i m_07 = _mm_set1_epi8(0x07);
+    const __m128i m_1f = _mm_set1_epi8(0x1F);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i r, g, b;
+        deinterleave_ssse3(rgb + i * 3, &r, &g, &b);
+        //byte-wise shifts via 16-bit shifts, masking what crossed over
+        __m128i hi = _mm_or_si128(_mm_and_si128(r, m_f8), _mm_and_si128(_mm_srli_epi16(g, 5), m_07));
+        __m128i lo = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(g, 3), m_e0), _mm_and_si128(_mm_srli_epi16(b, 3), m_1f));
+        _mm_storeu_si128((__m128i *)(out + i * 2), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i *)(out + i * 2 + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+    return i * 2 + span_rgb565_scalar(rgb + i * 3, out + i * 2, n - i);
+}
+
+__attribute__((target("ssse3")))
+static size_t span_rgb444_ssse3(const uint8_t *rgb, uint8_t *out, size_t n) {
+    PACK444_MASKS;
+    const __m128i m_f0 = _mm_set1_epi8((char)0xF0);
+    const __m128i m_0f = _mm_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i r, g, b;
+        deinterleave_ssse3(rgb + i * 3, &r, &g, &b);
+        __m128i r4 = _mm_and_si128(_mm_srli_epi16(r, 4), m_0f);
+        __m128i g4 = _mm_and_si128(_mm_srli_epi16(g, 4), m_0f);
+        __m128i b4 = _mm_and_si128(_mm_srli_epi16(b, 4), m_0f);
+        __m128i e = _mm_or_si128(_mm_and_si128(r, m_f0), g4);                    // RRRRGGGG of pixel 2k
+        __m128i f = _mm_or_si128(_mm_and_si128(b, m_f0), _mm_srli_si128(r4, 1)); // BBBB of 2k, RRRR of 2k+1
+        __m128i h = _mm_or_si128(_mm_and_si128(g, m_f0), b4);                    // GGGGBBBB of pixel 2k+1
+        __m128i o0 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(e, e0), _mm_shuffle_epi8(f, f0)), _mm_shuffle_epi8(h, h0));
+        __m128i o1 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(e, e1), _mm_shuffle_epi8(f, f1)), _mm_shuffle_epi8(h, h1));
+        _mm_storeu_si128((__m128i *)(out + i / 2 * 3), o0);
+        _mm_storel_epi64((__m128i *)(out + i / 2 * 3 + 16), o1);
+    }
+    return i / 2 * 3 + span_rgb444_scalar(rgb + i * 3, out + i / 2 * 3, n - i);
+}
+
+//two 16 pixel blocks, one per 128-bit lane; pshufb works within lanes so the SSSE3 masks carry over
+__attribute__((target("avx2")))
+static inline void deinterleave_avx2(const uint8_t *rgb, __m256i *r, __m256i *g, __m256i *b) {
+    DEINTERLEAVE_MASKS;
+#define LANES(lo, hi) _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1)
+#define LOAD2(off) LANES(_mm_loadu_si128((const __m128i *)(rgb + (off))), _mm_loadu_si128((const __m128i *)(rgb + 48 + (off))))
+#define MASK2(m) LANES(m, m)
+    __m256i p0 = LOAD2(0), p1 = LOAD2(16), p2 = LOAD2(32);
+    *r = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(p0, MASK2(r0)), _mm256_shuffle_epi8(p1, MASK2(r1))), _mm256_shuffle_epi8(p2, MASK2(r2)));
+    *g = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(p0, MASK2(g0)), _mm256_shuffle_epi8(p1, MASK2(g1))), _mm256_shuffle_epi8(p2, MASK2(g2)));
+    *b = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(p0, MASK2(b0)), _mm256_shuffle_epi8(p1, MASK2(b1))), _mm256_shuffle_epi8(p2, MASK2(b2)));
+}
+
+__attribute__((target("avx2")))
+static size_t span_rgb565_avx2(const uint8_t *rgb, uint8_t *out, size_t n) {
+    const __m256i m_f8 = _mm256_set1_epi8((char)0xF8);
+    const __m256i m_e0 = _mm256_set1_epi8((char)0xE0);
+    const __m256i m_07 = _mm256_set1_epi8(0x07);
+    const __m256i m_1f = _mm256_set1_epi8(0x1F);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i r, g, b;
+        deinterleave_avx2(rgb + i * 3, &r, &g, &b);
+        __m256i hi = _mm256_or_si256(_mm256_and_si256(r, m_f8), _mm256_and_si256(_mm256_srli_epi16(g, 5), m_07));
+        __m256i lo = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi16(g, 3), m_e0), _mm256_and_si256(_mm256_srli_epi16(b, 3), m_1f));
+        __m256i ulo = _mm256_unpacklo_epi8(hi, lo); // pixels 0-7 | 16-23
+        __m256i uhi = _mm256_unpackhi_epi8(hi, lo); // pixels 8-15 | 24-31
+        _mm256_storeu_si256((__m256i *)(out + i * 2), _mm256_permute2x128_si256(ulo, uhi, 0x20));
+        _mm256_storeu_si256((__m256i *)(out + i * 2 + 32), _mm256_permute2x128_si256(ulo, uhi, 0x31));
+    }
+    return i * 2 + span_rgb565_ssse3(rgb + i * 3, out + i * 2, n - i);
+}
+
+__attribute__((target("avx2")))
+static size_t span_rgb444_avx2(const uint8_t *rgb, uint8_t *out, size_t n) {
+    PACK444_MASKS;
+    const __m256i m_f0 = _mm256_set1_epi8((char)0xF0);
+    const __m256i m_0f = _mm256_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i r, g, b;
+        deinterleave_avx2(rgb + i * 3, &r, &g, &b);
+        __m256i r4 = _mm256_and_si256(_mm256_srli_epi16(r, 4), m_0f);
+        __m256i g4 = _mm256_and_si256(_mm256_srli_epi16(g, 4), m_0f);
+        __m256i b4 = _mm256_and_si256(_mm256_srli_epi16(b, 4), m_0f);
+        __m256i e = _mm256_or_si256(_mm256_and_si256(r, m_f0), g4);
+        __m256i f = _mm256_or_si256(_mm256_and_si256(b, m_f0), _mm256_srli_si256(r4, 1));
+        __m256i h = _mm256_or_si256(_mm256_and_si256(g, m_f0), b4);
+        __m256i o0 = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(e, MASK2(e0)), _mm256_shuffle_epi8(f, MASK2(f0))), _mm256_shuffle_epi8(h, MASK2(h0)));
+        __m256i o1 = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(e, MASK2(e1)), _mm256_shuffle_epi8(f, MASK2(f1))), _mm256_shuffle_epi8(h, MASK2(h1)));
+        uint8_t *dst = out + i / 2 * 3;
+        _mm_storeu_si128((__m128i *)dst, _mm256_castsi256_si128(o0));
+        _mm_storel_epi64((__m128i *)(dst + 16), _mm256_castsi256_si128(o1));
+        _mm_storeu_si128((__m128i *)(dst + 24), _mm256_extracti128_si256(o0, 1));
+        _mm_storel_epi64((__m128i *)(dst + 40), _mm256_extracti128_si256(o1, 1));
+    }
+#undef LANES
+#undef LOAD2
+#undef MASK2
+    return i / 2 * 3 + span_rgb444_ssse3(rgb + i * 3, out + i / 2 * 3, n - i);
+}
+#undef Z
+
+static int span_has_ssse3(void) {
+    return __builtin_cpu_supports("ssse3");
+}
+
+static int span_has_avx2(void) {
+    return __builtin_cpu_supports("avx2");
+}
+#endif //x86
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+
+static size_t span_rgb565_neon(const uint8_t *rgb, uint8_t *out, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x3_t px = vld3q_u8(rgb + i * 3);
+        uint8x16x2_t o;
+        o.val[0] = vorrq_u8(vandq_u8(px.val[0], vdupq_n_u8(0xF8)), vshrq_n_u8(px.val[1], 5));
+        o.val[1] = vorrq_u8(vshlq_n_u8(vshrq_n_u8(px.val[1], 2), 5), vshrq_n_u8(px.val[2], 3));
+        vst2q_u8(out + i * 2, o); //interleaves into big-endian pairs
+    }
+    return i * 2 + span_rgb565_scalar(rgb + i * 3, out + i * 2, n - i);
+}
+
+static size_t span_rgb444_neon(const uint8_t *rgb, uint8_t *out, size_t n) {
+    const uint8x8_t m_f0 = vdup_n_u8(0xF0);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x3_t px = vld3q_u8(rgb + i * 3);
+        //split even and odd pixels: each pair becomes three bytes
+        uint8x16x2_t r = vuzpq_u8(px.val[0], px.val[0]);
+        uint8x16x2_t g = vuzpq_u8(px.val[1], px.val[1]);
+        uint8x16x2_t b = vuzpq_u8(px.val[2], px.val[2]);
+        uint8x8x3_t o;
+        o.val[0] = vorr_u8(vand_u8(vget_low_u8(r.val[0]), m_f0), vshr_n_u8(vget_low_u8(g.val[0]), 4));
+        o.val[1] = vorr_u8(vand_u8(vget_low_u8(b.val[0]), m_f0), vshr_n_u8(vget_low_u8(r.val[1]), 4));
+        o.val[2] = vorr_u8(vand_u8(vget_low_u8(g.val[1]), m_f0), vshr_n_u8(vget_low_u8(b.val[1]), 4));
+        vst3_u8(out + i / 2 * 3, o);
+    }
+    return i / 2 * 3 + span_rgb444_scalar(rgb + i * 3, out + i / 2 * 3, n - i);
+}
+#endif //NEON
+
+static const struct color_span_kernel span_kernels[] = {
+    { "scalar", span_rgb565_scalar, span_rgb444_scalar, span_always },
+#if defined(__x86_64__) || defined(__i386__)
+    { "ssse3", span_rgb565_ssse3, span_rgb444_ssse3, span_has_ssse3 },
+    { "avx2", span_rgb565_avx2, span_rgb444_avx2, span_has_avx2 },
+#endif
+#if defined(__aarch64__) || defined(__ARM_NEON)
+    { "neon", span_rgb565_neon, span_rgb444_neon, span_always },
+#endif
+};
+
+static const struct color_span_kernel *span_active = NULL;
+
+//best supported variant: the table is ordered from slowest to fastest
+static const struct color_span_kernel *span_select(void) {
+    if (!span_active) {
+        const struct color_span_kernel *best = &span_kernels[0];
+        for (size_t i = 1; i < sizeof(span_kernels) / sizeof(span_kernels[0]); i++) {
+            if (span_kernels[i].supported()) {
+                best = &span_kernels[i];
+            }
+        }
+        span_active = best; //idempotent, so a racing first call is harmless
+    }
+    return span_active;
+}
+
+size_t color_span_rgb565(const uint8_t *rgb, uint8_t *out, size_t n) {
+    return span_select()->rgb565(rgb, out, n);
+}
+
+size_t color_span_rgb444(const uint8_t *rgb, uint8_t *out, size_t n) {
+    return span_select()->rgb444(rgb, out, n);
+}
+
+const struct color_span_kernel *color_span_kernels(size_t *count) {
+    *count = sizeof(span_kernels) / sizeof(span_kernels[0]);
+    return span_kernels;
+}
+
+const char *color_span_active(void) {
+    return span_select()->name;
+}
@@ -21,4 +21,26 @@ struct GC9A01_color rgb_to_16bit(uint8_t r, uint8_t g, uint8_t b);
 /* Pack 8-bit RGB into 18-bit (6-6-6) color. */
 struct GC9A01_color rgb_to_18bit(uint8_t r, uint8_t g, uint8_t b);
 
+/* Span conversion: n RGB888 pixels in, panel bytes out, returns bytes written.
+ * RGB565: 2 bytes per pixel, big-endian, same result as rgb_to_16bit.
+ * RGB444: the 12-bit stream, two pixels in three bytes
+ * (RRRRGGGG BBBBRRRR GGGGBBBB); an odd last pixel is written as rgb_to_12bit.
+ * The SIMD variant is picked at first use from what the CPU supports;
+ * every variant is bit-exact with the scalar one. */
+typedef size_t (*color_span_fn)(const uint8_t *rgb, uint8_t *out, size_t n);
+
+size_t color_span_rgb565(const uint8_t *rgb, uint8_t *out, size_t n);
+size_t color_span_rgb444(const uint8_t *rgb, uint8_t *out, size_t n);
+
+struct color_span_kernel {
+    const char *name;
+    color_span_fn rgb565;
+    color_span_fn rgb444;
+    int (*supported)(void);
+};
+
+/* All compiled-in variants, scalar first; for benchmarks and checks */
+const struct color_span_kernel *color_span_kernels(size_t *count);
+const char *color_span_active(void);
+
 #endif
@@ -0,0 +1,228 @@
+/* layered compositor: per-layer buffers and damage, rebuilt into the
+output framebuffer one dirty tile run at a time */
+
+#include "compositor.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct comp_layer {
+    uint8_t *pixels;                // full-screen, framebuffer format
+    struct GC9A01_frame area;       // where the layer contributes (inclusive)
+    uint8_t opacity;
+    uint32_t color_key;
+    uint8_t key_px[FB_BPP];         // color_key in framebuffer format
+    int visible;
+    struct fb_damage damage;
+};
+
+static struct comp_layer layers[COMP_MAX_LAYERS]; //bottom first
+static int layer_count = 0;
+static uint16_t dirty[COMP_TILES_Y];               //bit tx set: tile (tx, ty) needs rebuilding
+static struct comp_stats stats;
+
+static void mark_tiles(struct GC9A01_frame f) {
+    for (int ty = f.start.Y / COMP_TILE; ty <= f.end.Y / COMP_TILE; ty++) {
+        for (int tx = f.start.X / COMP_TILE; tx <= f.end.X / COMP_TILE; tx++) {
+            dirty[ty] |= (uint16_t)(1u << tx);
+        }
+    }
+}
+
+//intersect two frames; returns 0 if they don't overlap
+static int frame_clip(struct GC9A01_frame a, struct GC9A01_frame b, struct GC9A01_frame *out) {
+    out->start.X = a.start.X > b.start.X ? a.start.X : b.start.X;
+    out->start.Y = a.start.Y > b.start.Y ? a.start.Y : b.start.Y;
+    out->end.X = a.end.X < b.end.X ? a.end.X : b.end.X;
+    out->end.Y = a.end.Y < b.end.Y ? a.end.Y : b.end.Y;
+    return out->start.X <= out->end.X && out->start.Y <= out->end.Y;
+}
+
+struct comp_layer *comp_layer_create(struct GC9A01_frame area, uint8_t opacity, uint32_t color_key) {
+    if (layer_count == COMP_MAX_LAYERS) {
+        fprintf(stderr, "compositor: all %d layers in use\n", COMP_MAX_LAYERS);
+        return NULL;
+    }
+    if (area.end.X >= FB_WIDTH) area.end.X = FB_WIDTH - 1;
+    if (area.end.Y >= FB_HEIGHT) area.end.Y = FB_HEIGHT - 1;
+
+    struct comp_layer *l = &layers[layer_count];
+    l->pixels = calloc(1, FB_SIZE); //black
+    if (!l->pixels) {
+        perror("calloc layer");
+        return NULL;
+    }
+    l->area = area;
+    l->opacity = opacity;
+    l->color_key = color_key;
+    fb_set_pixel(l->key_px, 0, 0, (uint8_t)(color_key >> 16), (uint8_t)(color_key >> 8), (uint8_t)color_key);
+    l->visible = 1;
+    l->damage.count = 0;
+    l->damage.scroll_pending = 0;
+    mark_tiles(area);
+    layer_count++;
+    return l;
+}
+
+uint8_t *comp_layer_pixels(struct comp_layer *layer) {
+    return layer->pixels;
+}
+
+void comp_layer_set_opacity(struct comp_layer *layer, uint8_t opacity) {
+    if (layer->opacity != opacity) {
+        layer->opacity = opacity;
+        mark_tiles(layer->area);
+    }
+}
+
+void comp_layer_set_visible(struct comp_layer *layer, int visible) {
+    if (layer->visible != !!visible) {
+        layer->visible = !!visible;
+        mark_tiles(layer->area);
+    }
+}
+
+void comp_layer_commit(struct comp_layer *layer) {
+    struct fb_damage pending;
+    fb_damage_take(&pending);
+    for (int i = 0; i < pending.count; i++) {
+        fb_damage_add(&layer->damage, pending.rects[i]);
+    }
+}
+
+void comp_layer_damage(struct comp_layer *layer, int x, int y, int w, int h) {
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > FB_WIDTH) w = FB_WIDTH - x;
+    if (y + h > FB_HEIGHT) h = FB_HEIGHT - y;
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+    struct GC9A01_frame f = {{(uint16_t)x, (uint16_t)y}, {(uint16_t)(x + w - 1), (uint16_t)(y + h - 1)}};
+    fb_damage_add(&layer->damage, f);
+}
+
+//draw one layer's part of span into out
+static void blit_layer(const struct comp_layer *l, uint8_t *out, struct GC9A01_frame span) {
+    struct GC9A01_frame c;
+    if (!frame_clip(l->area, span, &c)) {
+        return;
+    }
+    int keyed = l->color_key != COMP_NO_KEY;
+    size_t run = (size_t)(c.end.X - c.start.X + 1) * FB_BPP;
+    uint32_t a = l->opacity;
+
+    stats.layer_blits++;
+    for (int y = c.start.Y; y <= c.end.Y; y++) {
+        if (a == 255 && !keyed) {
+            memcpy(&out[FB_INDEX(c.start.X, y)], &l->pixels[FB_INDEX(c.start.X, y)], run);
+            continue;
+        }
+        for (int x = c.start.X; x <= c.end.X; x++) {
+            const uint8_t *src = &l->pixels[FB_INDEX(x, y)];
+            if (keyed && memcmp(src, l->key_px, FB_BPP) == 0) {
+                continue;
+            }
+            if (a == 255) {
+                memcpy(&out[FB_INDEX(x, y)], src, FB_BPP);
+                continue;
+            }
+            uint8_t sr, sg, sb, dr, dg, db;
+            fb_get_pixel(l->pixels, x, y, &sr, &sg, &sb);
+            fb_get_pixel(out, x, y, &dr, &dg, &db);
+            fb_set_pixel(out, x, y,
+                         (uint8_t)((sr * a + dr * (255 - a) + 127) / 255),
+                         (uint8_t)((sg * a + dg * (255 - a) + 127) / 255),
+                         (uint8_t)((sb * a + db * (255 - a) + 127) / 255));
+        }
+    }
+}
+
+static void composite_span(uint8_t *out, struct GC9A01_frame span) {
+    //start from the topmost layer that hides everything below it
+    int base = -1;
+    for (int i = layer_count - 1; i >= 0; i--) {
+        const struct comp_layer *l = &layers[i];
+        if (l->visible && l->opacity == 255 && l->color_key == COMP_NO_KEY &&
+            l->area.start.X <= span.start.X && l->area.start.Y <= span.start.Y &&
+            l->area.end.X >= span.end.X && l->area.end.Y >= span.end.Y) {
+            base = i;
+            break;
+        }
+    }
+    if (base < 0) {
+        size_t run = (size_t)(span.end.X - span.start.X + 1) * FB_BPP;
+        for (int y = span.start.Y; y <= span.end.Y; y++) {
+            memset(&out[FB_INDEX(span.start.X, y)], 0x00, run);
+        }
+        base = 0;
+    }
+    for (int i = base; i < layer_count; i++) {
+        if (layers[i].visible) {
+            blit_layer(&layers[i], out, span);
+        }
+    }
+}
+
+int comp_composite(uint8_t *framebuffer) {
+    int rebuilt = 0;
+
+    for (int i = 0; i < layer_count; i++) {
+        struct comp_layer *l = &layers[i];
+        struct GC9A01_frame c;
+        for (int r = 0; r < l->damage.count; r++) {
+            //damage outside the area or on a hidden layer changes nothing on screen
+            if (l->visible && frame_clip(l->damage.rects[r], l->area, &c)) {
+                mark_tiles(c);
+            }
+        }
+        l->damage.count = 0;
+    }
+
+    //one span per run of dirty tiles in a tile row
+    for (int ty = 0; ty < COMP_TILES_Y; ty++) {
+        int tx = 0;
+        while (dirty[ty] >> tx) {
+            if (!(dirty[ty] & (1u << tx))) {
+                tx++;
+                continue;
+            }
+            int start = tx;
+            while (tx < COMP_TILES_X && (dirty[ty] & (1u << tx))) {
+                tx++;
+            }
+            int x = start * COMP_TILE;
+            int y = ty * COMP_TILE;
+            int w = (tx < COMP_TILES_X ? tx * COMP_TILE : FB_WIDTH) - x;
+            int h = (ty + 1 < COMP_TILES_Y ? COMP_TILE : FB_HEIGHT - y);
+            struct GC9A01_frame span = {{(uint16_t)x, (uint16_t)y}, {(uint16_t)(x + w - 1), (uint16_t)(y + h - 1)}};
+            composite_span(framebuffer, span);
+            fb_damage_mark(x, y, w, h);
+            rebuilt += tx - start;
+        }
+        dirty[ty] = 0;
+    }
+
+    stats.composites++;
+    stats.tiles += (uint64_t)rebuilt;
+    return rebuilt;
+}
+
+void comp_destroy(void) {
+    for (int i = 0; i < layer_count; i++) {
+        free(layers[i].pixels);
+        layers[i].pixels = NULL;
+    }
+    layer_count = 0;
+    memset(dirty, 0, sizeof(dirty));
+}
+
+void comp_get_stats(struct comp_stats *out) {
+    *out = stats;
+}
+
+void comp_reset_stats(void) {
+    struct comp_stats zero = {0};
+    stats = zero;
+}
@@ -0,0 +1,57 @@
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#include <stdint.h>
+#include "GC9A01.h"
+#include "framebuffer.h"
+
+/* Layered compositor: a background, the text and overlays each draw
+ * into their own full-screen buffer (framebuffer format, so every
+ * fb_draw_* primitive works on them) and keep their own damage list.
+ * comp_composite() rebuilds only the 16x16 tiles some layer damaged,
+ * blending bottom to top, into the output framebuffer and marks those
+ * tiles as fb damage; fb_flush_damage() then sends them. Changing the
+ * SoC overlay therefore never redraws text, and new text never
+ * redraws the overlay.
+ *
+ * A layer contributes only inside its area. Pixels equal to its colour
+ * key are transparent; opacity blends the rest over what lies below.
+ *
+ * Typical cycle: draw into a layer, comp_layer_commit() it (moves the
+ * pending fb damage to that layer), repeat for other layers, then
+ * comp_composite() and fb_flush_damage(). Text hardware scroll moves
+ * the whole panel, so it does not combine with the compositor.
+ *
+ * The daemon stacks a background layer (socket blits) under one layer
+ * per widget; see widget_layers_create().
+ */
+
+#define COMP_MAX_LAYERS 8
+#define COMP_TILE 16
+#define COMP_TILES_X ((FB_WIDTH + COMP_TILE - 1) / COMP_TILE)
+#define COMP_TILES_Y ((FB_HEIGHT + COMP_TILE - 1) / COMP_TILE)
+#define COMP_NO_KEY 0xFF000000u //colour key off; keys are GLYPH_RGB values
+
+struct comp_layer;
+
+struct comp_stats {
+    uint64_t composites;    // comp_composite calls
+    uint64_t tiles;         // tiles rebuilt
+    uint64_t layer_blits;   // layer spans copied or blended into the output
+};
+
+/* Stacks a new layer on top; its whole area starts damaged.
+ * Returns NULL when all COMP_MAX_LAYERS are in use or out of memory. */
+struct comp_layer *comp_layer_create(struct GC9A01_frame area, uint8_t opacity, uint32_t color_key);
+uint8_t *comp_layer_pixels(struct comp_layer *layer);
+void comp_layer_set_opacity(struct comp_layer *layer, uint8_t opacity);
+void comp_layer_set_visible(struct comp_layer *layer, int visible);
+void comp_layer_commit(struct comp_layer *layer);  //take the pending fb damage for this layer
+void comp_layer_damage(struct comp_layer *layer, int x, int y, int w, int h);
+int comp_composite(uint8_t *framebuffer);          //returns the number of tiles rebuilt
+void comp_destroy(void);                           //frees every layer
+
+void comp_get_stats(struct comp_stats *stats);
+void comp_reset_stats(void);
+
+#endif //COMPOSITOR_H
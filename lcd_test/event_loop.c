@@ -0,0 +1,136 @@
+/* epoll event loop: input socket, deadline timerfd and shutdown signalfd */
+
+#include "event_loop.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+
+static int epoll_fd = -1;
+static int timer_fd = -1;
+static int signal_fd = -1;
+static int input = -1;
+static int timer_armed = 0;
+static sigset_t stop_signals;
+static struct event_loop_stats stats;
+
+static int watch(int fd) {
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        perror("epoll_ctl");
+        return -1;
+    }
+    return 0;
+}
+
+int event_loop_init(int input_fd) {
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    //blocked signals stay queued for the signalfd instead of killing the process
+    if (pthread_sigmask(SIG_BLOCK, &stop_signals, NULL) != 0) {
+        perror("pthread_sigmask");
+        return -1;
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    signal_fd = signalfd(-1, &stop_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (epoll_fd < 0 || timer_fd < 0 || signal_fd < 0) {
+        perror("event loop fds");
+        event_loop_close();
+        return -1;
+    }
+    if (watch(input_fd) != 0 || watch(timer_fd) != 0 || watch(signal_fd) != 0) {
+        event_loop_close();
+        return -1;
+    }
+    input = input_fd;
+    timer_armed = 0;
+    return 0;
+}
+
+//one-shot timerfd; re-armed only when the deadline is set or cleared
+static void arm_timer(int timeout_ms) {
+    struct itimerspec its = {0};
+    if (timeout_ms > 0) {
+        its.it_value.tv_sec = timeout_ms / 1000;
+        its.it_value.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+    } else if (!timer_armed) {
+        return; //already disarmed
+    }
+    if (timerfd_settime(timer_fd, 0, &its, NULL) != 0) {
+        perror("timerfd_settime");
+    }
+    timer_armed = timeout_ms > 0;
+}
+
+unsigned event_loop_wait(int timeout_ms) {
+    struct epoll_event events[3];
+    unsigned fired = 0;
+
+    //a zero timeout is already due: only check what is ready
+    arm_timer(timeout_ms);
+    int n = epoll_wait(epoll_fd, events, 3, timeout_ms == 0 ? 0 : -1);
+    if (n < 0) {
+        if (errno != EINTR) {
+            perror("epoll_wait");
+        }
+        return 0;
+    }
+    if (timeout_ms == 0) {
+        fired |= EVENT_TIMER;
+    }
+
+    for (int i = 0; i < n; i++) {
+        int fd = events[i].data.fd;
+        if (fd == input) {
+            fired |= EVENT_INPUT;
+        } else if (fd == timer_fd) {
+            uint64_t expirations;
+            if (read(timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+                fired |= EVENT_TIMER;
+            }
+            timer_armed = 0;
+        } else if (fd == signal_fd) {
+            struct signalfd_siginfo si;
+            if (read(signal_fd, &si, sizeof(si)) == sizeof(si)) {
+                printf("Received signal %u, shutting down\n", si.ssi_signo);
+                fired |= EVENT_STOP;
+            }
+        }
+    }
+
+    stats.wakeups++;
+    if (fired & EVENT_INPUT) {
+        stats.input++;
+    }
+    if (fired & EVENT_TIMER) {
+        stats.timer++;
+    }
+    return fired;
+}
+
+void event_loop_close(void) {
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+    }
+    if (timer_fd >= 0) {
+        close(timer_fd);
+    }
+    if (signal_fd >= 0) {
+        close(signal_fd); //signals stay blocked: a second Ctrl-C can't cut the cleanup short
+    }
+    epoll_fd = timer_fd = signal_fd = input = -1;
+}
+
+void event_loop_get_stats(struct event_loop_stats *out) {
+    *out = stats;
+}
@@ -0,0 +1,34 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <stdint.h>
+
+/* Event loop for the display daemon: one epoll set over the input
+ * socket, a timerfd armed for the next frame or widget deadline, and a
+ * signalfd for SIGINT/SIGTERM. With nothing queued the process sleeps
+ * in epoll_wait until the next deadline: in the daemon, the clock
+ * widget's minute boundary and the battery widget's sysfs poll.
+ *
+ * event_loop_init() blocks SIGINT and SIGTERM for the calling thread and
+ * every thread started after it, so call it before flush_thread_start().
+ */
+
+#define EVENT_INPUT 0x1u    // input socket readable
+#define EVENT_TIMER 0x2u    // the timeout passed to event_loop_wait expired
+#define EVENT_STOP  0x4u    // SIGINT or SIGTERM: shut down
+
+struct event_loop_stats {
+    uint64_t wakeups;       // event_loop_wait returns
+    uint64_t input;         // ... with EVENT_INPUT
+    uint64_t timer;         // ... with EVENT_TIMER
+};
+
+int event_loop_init(int input_fd);          //-1 on error
+/* Sleep until input, a signal, or timeout_ms (-1: no timeout, 0: poll).
+ * Returns the EVENT_* bits that fired; 0 on an interrupted wait. */
+unsigned event_loop_wait(int timeout_ms);
+void event_loop_close(void);
+
+void event_loop_get_stats(struct event_loop_stats *stats);
+
+#endif //EVENT_LOOP_H
@@ -0,0 +1,39 @@
+/* framebuffer -> panel pixel packing, kept free of HAL calls
+so the build-time asset tools can link it */
+
+#include "framebuffer.h"
+#include "color_utils.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+//pack the framebuffer pixels inside frame into RGB565 in panel stream order, returns bytes written
+size_t fb_pack_rgb565(const uint8_t *framebuffer, struct GC9A01_frame frame, uint8_t *packed_buffer) {
+    /* GC9A01_frame uses inclusive end coords; convert to exclusive for loops. */
+    int x1 = frame.start.X;
+    int y1 = frame.start.Y;
+    int x2 = frame.end.X + 1;
+    int y2 = frame.end.Y + 1;
+
+    if (x1 < 0) x1 = 0;
+    if (y1 < 0) y1 = 0;
+    if (x2 > FB_WIDTH) x2 = FB_WIDTH;
+    if (y2 > FB_HEIGHT) y2 = FB_HEIGHT;
+    if (x2 <= x1 || y2 <= y1) {
+        return 0;
+    }
+
+    /* panel stream order is row-major, like the framebuffer: one span per row */
+    size_t index = 0;
+    for (int y = y1; y < y2; y++) {
+#ifdef FB_NATIVE_RGB565
+        size_t run = (size_t)(x2 - x1) * FB_BPP;
+        memcpy(&packed_buffer[index], &framebuffer[FB_INDEX(x1, y)], run);
+        index += run;
+#else
+        index += color_span_rgb565(&framebuffer[FB_INDEX(x1, y)], &packed_buffer[index], (size_t)(x2 - x1));
+#endif
+    }
+    return index;
+}
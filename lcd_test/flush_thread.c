@@ -0,0 +1,252 @@
+/* asynchronous flush thread: overlaps rendering of frame N+1
+with the SPI transfer of frame N using two swapping packed buffers */
+
+#include "flush_thread.h"
+#include "framebuffer.h"
+#include "buffer_pool.h"
+#include "GC9A01.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum slot_state {
+    SLOT_FREE,
+    SLOT_FILLING,   // renderer is packing into it
+    SLOT_PENDING,   // packed, waiting for the flush thread
+    SLOT_SENDING,   // owned by the flush thread
+};
+
+#define FLUSH_WINDOW_MAX (FB_DAMAGE_MAX * FB_SHADOW_WINDOWS_MAX) //changed windows (or disc bands) of every region
+
+struct flush_slot {
+    uint8_t *buf;                   // every window packed back to back
+    struct GC9A01_frame windows[FLUSH_WINDOW_MAX]; // changed parts of the damage, from the shadow diff
+    size_t len[FLUSH_WINDOW_MAX];   // packed bytes per window
+    int count;
+    struct fb_damage damage;        // as submitted, for merging into a replacement
+    enum slot_state state;
+};
+
+static struct flush_slot slots[2];
+static pthread_t flush_tid;
+static pthread_mutex_t flush_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flush_cond = PTHREAD_COND_INITIALIZER;
+static int flush_running = 0;
+static int flush_stop_req = 0;
+static int te_sync = 0;
+static struct flush_stats stats;
+
+static struct flush_slot *find_slot(enum slot_state state) {
+    for (int i = 0; i < 2; i++) {
+        if (slots[i].state == state) {
+            return &slots[i];
+        }
+    }
+    return NULL;
+}
+
+static void *flush_thread_main(void *arg) {
+    (void)arg;
+    int te_ready = 0; //just returned from a TE edge: send without another wait
+
+    pthread_mutex_lock(&flush_lock);
+    for (;;) {
+        struct flush_slot *slot;
+        while ((slot = find_slot(SLOT_PENDING)) == NULL && !flush_stop_req) {
+            te_ready = 0; //that edge is gone by the time a frame arrives
+            pthread_cond_wait(&flush_cond, &flush_lock);
+        }
+        if (!slot) {
+            break; //stop requested and nothing left to send
+        }
+        if (te_sync && !te_ready) {
+            //the renderer may replace the frame meanwhile; whatever is pending after the edge goes out
+            pthread_mutex_unlock(&flush_lock);
+            int ret = GC9A01_te_wait(FLUSH_TE_TIMEOUT_MS);
+            pthread_mutex_lock(&flush_lock);
+            if (ret == 1) {
+                stats.te_edges++;
+            } else {
+                stats.te_timeouts++; //send anyway: a late frame beats a lost one
+            }
+            te_ready = 1;
+            continue;
+        }
+        te_ready = 0;
+        slot->state = SLOT_SENDING;
+        pthread_mutex_unlock(&flush_lock);
+
+        struct GC9A01_hal_stats before, after;
+        GC9A01_get_hal_stats(&before);
+        const uint8_t *data = slot->buf;
+        for (int i = 0; i < slot->count; i++) {
+            GC9A01_set_frame(slot->windows[i]);
+            GC9A01_write((uint8_t *)data, slot->len[i]);
+            data += slot->len[i];
+        }
+        if (slot->damage.scroll_pending) {
+            GC9A01_set_scroll_start(slot->damage.scroll_start);
+        }
+        GC9A01_get_hal_stats(&after);
+
+        pthread_mutex_lock(&flush_lock);
+        stats.flushed++;
+        stats.last.syscalls = after.syscalls - before.syscalls;
+        stats.last.dc_toggles = after.dc_toggles - before.dc_toggles;
+        stats.last.bytes = after.bytes - before.bytes;
+        stats.last.transfer_ns = after.transfer_ns - before.transfer_ns;
+        slot->state = SLOT_FREE;
+        pthread_cond_broadcast(&flush_cond);
+    }
+    pthread_mutex_unlock(&flush_lock);
+    return NULL;
+}
+
+int flush_thread_start(int te_line) {
+    if (flush_running) {
+        return 0;
+    }
+    for (int i = 0; i < 2; i++) {
+        //borrowed for the thread's lifetime, so submits never allocate
+        slots[i].buf = buffer_pool_get(POOL_BUF_BYTES);
+        if (!slots[i].buf) {
+            buffer_pool_put(slots[0].buf);
+            slots[0].buf = NULL;
+            return -1;
+        }
+        slots[i].count = 0;
+        slots[i].damage.count = 0;
+        slots[i].state = SLOT_FREE;
+    }
+    flush_stop_req = 0;
+    te_sync = 0;
+    if (te_line >= 0) {
+        if (GC9A01_te_open(te_line) == 0) {
+            te_sync = 1;
+        } else {
+            fprintf(stderr, "TE line %d unavailable, flushing without it\n", te_line);
+        }
+    }
+    if (pthread_create(&flush_tid, NULL, flush_thread_main, NULL) != 0) {
+        perror("pthread_create flush");
+        if (te_sync) {
+            GC9A01_te_close();
+            te_sync = 0;
+        }
+        for (int i = 0; i < 2; i++) {
+            buffer_pool_put(slots[i].buf);
+            slots[i].buf = NULL;
+        }
+        return -1;
+    }
+    flush_running = 1;
+    return 0;
+}
+
+//diff the damaged regions against the shadow and pack what changed; never blocks on SPI
+void flush_submit_damage(const uint8_t *framebuffer, const struct fb_damage *damage) {
+    struct fb_damage merged = *damage;
+    struct fb_shadow_stats before, after;
+    int replaced = 0;
+
+    pthread_mutex_lock(&flush_lock);
+    stats.submitted++;
+
+    //at most one slot is SENDING, so the other one belongs to the renderer
+    struct flush_slot *slot = find_slot(SLOT_PENDING);
+    if (slot) {
+        //previous frame never started: replace it, covering both damage lists
+        for (int i = 0; i < slot->damage.count; i++) {
+            fb_damage_add(&merged, slot->damage.rects[i]);
+        }
+        if (!merged.scroll_pending && slot->damage.scroll_pending) {
+            merged.scroll_pending = 1;
+            merged.scroll_start = slot->damage.scroll_start;
+        }
+        stats.replaced++;
+        replaced = 1;
+    } else {
+        slot = find_slot(SLOT_FREE);
+    }
+    slot->state = SLOT_FILLING;
+    pthread_mutex_unlock(&flush_lock);
+
+    //the shadow counted the replaced frame's windows as sent; they weren't
+    if (replaced) {
+        for (int i = 0; i < slot->count; i++) {
+            fb_shadow_invalidate_frame(slot->windows[i]);
+        }
+    }
+
+    //the shadow is only touched on this thread, and framebuffer holds the latest state of
+    //every pixel, so packing now is exact; fb_damage_add keeps the regions, and so the
+    //windows inside them, within one full screen, the slot size
+    slot->damage = merged;
+    slot->count = 0;
+    fb_get_shadow_stats(&before);
+    size_t off = 0;
+    for (int i = 0; i < merged.count; i++) {
+        int n = fb_shadow_windows(framebuffer, merged.rects[i], &slot->windows[slot->count], FB_SHADOW_WINDOWS_MAX);
+        for (int w = slot->count; w < slot->count + n; w++) {
+            slot->len[w] = fb_pack_rgb565(framebuffer, slot->windows[w], slot->buf + off);
+            off += slot->len[w];
+        }
+        slot->count += n;
+    }
+    fb_get_shadow_stats(&after);
+
+    pthread_mutex_lock(&flush_lock);
+    uint64_t disc_px = after.disc_skipped_px - before.disc_skipped_px;
+    stats.disc_skipped_bytes += disc_px * 2;
+    stats.unchanged_bytes += ((after.requested_px - before.requested_px) - (after.sent_px - before.sent_px) - disc_px) * 2;
+    if (slot->count == 0 && !merged.scroll_pending) {
+        slot->state = SLOT_FREE; //the panel already shows all of it
+    } else {
+        slot->state = SLOT_PENDING;
+    }
+    pthread_cond_broadcast(&flush_cond);
+    pthread_mutex_unlock(&flush_lock);
+}
+
+void flush_submit(const uint8_t *framebuffer, struct GC9A01_frame frame) {
+    struct fb_damage damage = { .count = 1, .rects = { frame } };
+    flush_submit_damage(framebuffer, &damage);
+}
+
+void flush_wait_idle(void) {
+    pthread_mutex_lock(&flush_lock);
+    while (find_slot(SLOT_PENDING) || find_slot(SLOT_SENDING)) {
+        pthread_cond_wait(&flush_cond, &flush_lock);
+    }
+    pthread_mutex_unlock(&flush_lock);
+}
+
+//sends whatever is still pending, then joins the thread
+void flush_thread_stop(void) {
+    if (!flush_running) {
+        return;
+    }
+    pthread_mutex_lock(&flush_lock);
+    flush_stop_req = 1;
+    pthread_cond_broadcast(&flush_cond);
+    pthread_mutex_unlock(&flush_lock);
+
+    pthread_join(flush_tid, NULL);
+    flush_running = 0;
+    if (te_sync) {
+        GC9A01_te_close();
+        te_sync = 0;
+    }
+    for (int i = 0; i < 2; i++) {
+        buffer_pool_put(slots[i].buf);
+        slots[i].buf = NULL;
+    }
+}
+
+void flush_get_stats(struct flush_stats *out) {
+    pthread_mutex_lock(&flush_lock);
+    *out = stats;
+    pthread_mutex_unlock(&flush_lock);
+}
@@ -0,0 +1,48 @@
+#ifndef FLUSH_THREAD_H
+#define FLUSH_THREAD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "GC9A01.h"
+#include "framebuffer.h"
+
+/* Asynchronous flush: a dedicated thread owns the SPI device and sends
+ * packed frames while the caller renders the next one. Two packed
+ * buffers swap on submit; if a submitted frame has not started sending
+ * when the next one arrives, the newer one replaces it (latest wins)
+ * and their damage lists are merged. A submit carries up to
+ * FB_DAMAGE_MAX regions; on the caller's thread each is diffed against
+ * the framebuffer shadow (fb_shadow_windows), and only the windows that
+ * changed are packed and sent, split into disc bands under fb_set_disc_clip.
+ *
+ * With a TE line the thread waits for the panel's tearing-effect edge
+ * (at most FLUSH_TE_TIMEOUT_MS) right before it takes a frame, so the
+ * transfer starts in vertical blanking and the renderer never waits
+ * for it; a frame submitted during the wait still replaces the pending one.
+ *
+ * Once started, no other thread may call GC9A01_* until flush_thread_stop.
+ */
+
+#define FLUSH_TE_TIMEOUT_MS 20 // a little over one 60 Hz panel refresh
+
+struct flush_stats {
+    uint64_t submitted;     // flush_submit/flush_submit_damage calls
+    uint64_t flushed;       // frames actually sent
+    uint64_t replaced;      // pending frames superseded before sending
+    uint64_t te_edges;      // frames started on a TE edge
+    uint64_t te_timeouts;   // TE waits that gave up
+    uint64_t unchanged_bytes; // damaged RGB565 bytes the panel already showed, never packed
+    uint64_t disc_skipped_bytes; // changed RGB565 bytes outside the visible disc, never packed
+    struct GC9A01_hal_stats last; // transfer cost of the last sent frame
+};
+
+/* te_line < 0 sends as soon as a frame is pending. If the TE line can't be
+ * opened the thread sends without it. */
+int flush_thread_start(int te_line);
+void flush_submit(const uint8_t *framebuffer, struct GC9A01_frame frame);
+void flush_submit_damage(const uint8_t *framebuffer, const struct fb_damage *damage);
+void flush_wait_idle(void);
+void flush_thread_stop(void);
+void flush_get_stats(struct flush_stats *stats);
+
+#endif //FLUSH_THREAD_H
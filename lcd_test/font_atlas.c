@@ -0,0 +1,145 @@
+/* Unicode font atlas: mmap'd glyph blocks, paged in on first use, with
+the built-in ASCII font behind it */
+
+#include "font_atlas.h"
+#include "font8x16.h"
+#include "utf8.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define BLOCK_BYTES (FONT_ATLAS_BLOCK * sizeof(struct font_atlas_glyph))
+
+static const uint8_t *atlas = NULL;
+static size_t atlas_size = 0;
+static const uint32_t *dir = NULL;
+static uint32_t page_count = 0;
+static uint8_t touched[FONT_ATLAS_PAGES / 8];
+static struct font_atlas_stats stats;
+
+int font_atlas_open(const char *path) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct font_atlas_header)) {
+        fprintf(stderr, "font atlas %s is truncated\n", path);
+        close(fd);
+        return -1;
+    }
+    //no MAP_POPULATE: blocks come in as they are first drawn
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap font atlas");
+        return -1;
+    }
+
+    const struct font_atlas_header *h = map;
+    if (memcmp(h->magic, FONT_ATLAS_MAGIC, 4) != 0 || h->version != FONT_ATLAS_VERSION ||
+        h->glyph_height != FONT_ATLAS_HEIGHT || h->page_count > FONT_ATLAS_PAGES ||
+        h->dir_offset % 4 != 0 ||
+        (uint64_t)h->dir_offset + (uint64_t)h->page_count * 4 > (uint64_t)st.st_size) {
+        fprintf(stderr, "font atlas %s: bad header\n", path);
+        munmap(map, (size_t)st.st_size);
+        return -1;
+    }
+    //lookups jump around: don't read ahead into blocks nobody asked for
+    madvise(map, (size_t)st.st_size, MADV_RANDOM);
+
+    font_atlas_close();
+    atlas = map;
+    atlas_size = (size_t)st.st_size;
+    dir = (const uint32_t *)(atlas + h->dir_offset);
+    page_count = h->page_count;
+    return 0;
+}
+
+void font_atlas_close(void) {
+    if (atlas) {
+        munmap((void *)atlas, atlas_size);
+    }
+    atlas = NULL;
+    atlas_size = 0;
+    dir = NULL;
+    page_count = 0;
+    memset(touched, 0, sizeof(touched));
+    stats.blocks_touched = 0;
+}
+
+static const struct font_atlas_glyph *atlas_lookup(uint32_t cp) {
+    uint32_t block = cp / FONT_ATLAS_BLOCK;
+    if (!atlas || block >= page_count || dir[block] == 0 ||
+        dir[block] % FONT_ATLAS_ALIGN != 0 || (uint64_t)dir[block] + BLOCK_BYTES > atlas_size) {
+        return NULL;
+    }
+    if (!(touched[block / 8] & (1u << (block % 8)))) {
+        touched[block / 8] |= (uint8_t)(1u << (block % 8));
+        stats.blocks_touched++;
+    }
+    const struct font_atlas_glyph *g =
+        (const struct font_atlas_glyph *)(atlas + dir[block]) + cp % FONT_ATLAS_BLOCK;
+    return (g->width == 8 || g->width == 16) ? g : NULL;
+}
+
+int font_atlas_glyph(uint32_t cp, uint16_t rows[FONT_ATLAS_HEIGHT]) {
+    const struct font_atlas_glyph *g = NULL;
+
+    stats.lookups++;
+    //ASCII always comes from the built-in font, atlas or not
+    if (cp >= 128) {
+        g = atlas_lookup(cp);
+        if (!g) {
+            stats.fallbacks++;
+            g = atlas_lookup(UTF8_REPLACEMENT);
+            cp = '?';
+        }
+    }
+    if (g) {
+        if (rows) {
+            memcpy(rows, g->rows, sizeof(g->rows));
+        }
+        return g->width;
+    }
+    if (rows) {
+        for (int r = 0; r < FONT_ATLAS_HEIGHT; r++) {
+            rows[r] = (uint16_t)(font8x16[cp][r] << 8);
+        }
+    }
+    return 8;
+}
+
+void font_atlas_get_stats(struct font_atlas_stats *out) {
+    *out = stats;
+    out->mapped_bytes = atlas_size;
+    out->resident_bytes = 0;
+    if (!atlas) {
+        return;
+    }
+    long page = sysconf(_SC_PAGESIZE);
+    size_t pages = (atlas_size + (size_t)page - 1) / (size_t)page;
+    unsigned char vec[256];
+    for (size_t first = 0; first < pages; first += sizeof(vec)) {
+        size_t n = pages - first < sizeof(vec) ? pages - first : sizeof(vec);
+        size_t len = first + n == pages ? atlas_size - first * (size_t)page : n * (size_t)page;
+        if (mincore((void *)(atlas + first * (size_t)page), len, vec) != 0) {
+            return;
+        }
+        for (size_t i = 0; i < n; i++) {
+            if (vec[i] & 1) {
+                out->resident_bytes += (size_t)page;
+            }
+        }
+    }
+}
+
+void font_atlas_reset_stats(void) {
+    stats.lookups = 0;
+    stats.fallbacks = 0;
+}
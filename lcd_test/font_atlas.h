@@ -0,0 +1,65 @@
+#ifndef FONT_ATLAS_H
+#define FONT_ATLAS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Unicode font atlas: a compact file built from a BDF font at build time
+ * (tools/mkatlas, e.g. GNU Unifont) and mmap'd at startup. Nothing is read up front; the
+ * kernel pages a block of 256 code points in the first time one of them
+ * is drawn, so a CJK-sized font costs no startup time and only the
+ * blocks in use stay resident. Rendered glyphs are kept by the glyph
+ * cache, so the atlas is only consulted on a cache miss.
+ *
+ * File layout, little-endian:
+ *   struct font_atlas_header
+ *   uint32_t dir[page_count]          block offsets, 0: no glyphs in that block
+ *   struct font_atlas_glyph[256]      per block, each starting on a 4 KiB boundary
+ * Glyphs are 16 rows tall and 8 or 16 pixels wide (width 0: missing);
+ * bit 15 of a row is the leftmost pixel.
+ */
+
+#define FONT_ATLAS_PATH "./font.atlas"
+#define FONT_ATLAS_MAGIC "GCFA"
+#define FONT_ATLAS_VERSION 1
+#define FONT_ATLAS_HEIGHT 16
+#define FONT_ATLAS_BLOCK 256                          //code points per block
+#define FONT_ATLAS_PAGES (0x110000 / FONT_ATLAS_BLOCK) //blocks covering U+0000..U+10FFFF
+#define FONT_ATLAS_ALIGN 4096
+
+struct font_atlas_header {
+    char magic[4];
+    uint16_t version;
+    uint16_t glyph_height;
+    uint32_t page_count;        // directory entries
+    uint32_t dir_offset;
+};
+
+struct font_atlas_glyph {
+    uint8_t width;              // 8, 16, or 0 if the font has no such glyph
+    uint8_t reserved;
+    uint16_t rows[FONT_ATLAS_HEIGHT];
+};
+
+struct font_atlas_stats {
+    uint64_t lookups;           // font_atlas_glyph calls
+    uint64_t fallbacks;         // code points the atlas doesn't have
+    uint64_t blocks_touched;    // distinct blocks looked at since open
+    size_t mapped_bytes;        // atlas file size
+    size_t resident_bytes;      // of those, in the page cache right now
+};
+
+/* Map the atlas; returns -1 if it is missing or malformed, in which case
+ * only the built-in ASCII font is available. */
+int font_atlas_open(const char *path);
+void font_atlas_close(void);
+
+/* Bitmap of code point cp into rows (may be NULL), returning its width
+ * in pixels. ASCII always comes from the built-in font8x16; anything the
+ * atlas lacks is drawn as its U+FFFD, or as '?' without one. */
+int font_atlas_glyph(uint32_t cp, uint16_t rows[FONT_ATLAS_HEIGHT]);
+
+void font_atlas_get_stats(struct font_atlas_stats *stats);
+void font_atlas_reset_stats(void);  //lookups and fallbacks; blocks stay touched
+
+#endif //FONT_ATLAS_H
@@ -0,0 +1,73 @@
+/* frame pacing: coalesce updates into at most max_fps flushes */
+
+#include "frame_sched.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+static uint64_t interval_ns;
+static uint64_t next_frame_ns;  // earliest start of the next frame
+static uint64_t prev_frame_ns;  // next_frame_ns before the frame last begun
+static int pending = 0;
+static struct frame_sched_stats stats;
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+int frame_sched_init(int max_fps) {
+    if (max_fps <= 0) {
+        fprintf(stderr, "frame rate must be positive\n");
+        return -1;
+    }
+    interval_ns = 1000000000ull / (uint64_t)max_fps;
+    next_frame_ns = 0;
+    pending = 0;
+    return 0;
+}
+
+void frame_sched_mark(void) {
+    pending = 1;
+    stats.updates++;
+}
+
+int frame_sched_timeout_ms(int idle_ms) {
+    if (!pending) {
+        return idle_ms;
+    }
+    uint64_t now = monotonic_ns();
+    if (now >= next_frame_ns) {
+        return 0;
+    }
+    //round up, so the caller doesn't wake just before the frame is due
+    return (int)((next_frame_ns - now + 999999) / 1000000);
+}
+
+int frame_sched_begin(void) {
+    if (!pending || monotonic_ns() < next_frame_ns) {
+        return 0;
+    }
+    pending = 0;
+    prev_frame_ns = next_frame_ns;
+    next_frame_ns = monotonic_ns() + interval_ns;
+    stats.frames++;
+    return 1;
+}
+
+//nothing went out, so the next real frame needn't wait an interval
+void frame_sched_cancel(void) {
+    next_frame_ns = prev_frame_ns;
+    stats.frames--;
+}
+
+void frame_sched_get_stats(struct frame_sched_stats *out) {
+    *out = stats;
+}
+
+void frame_sched_reset_stats(void) {
+    struct frame_sched_stats zero = {0};
+    stats = zero;
+}
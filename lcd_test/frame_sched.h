@@ -0,0 +1,33 @@
+#ifndef FRAME_SCHED_H
+#define FRAME_SCHED_H
+
+#include <stdint.h>
+
+/* Frame scheduler: updates only mark the content dirty; a frame is
+ * rendered and flushed at most once per 1/max_fps, so a burst of
+ * messages inside one interval costs one flush. It never blocks:
+ * tearing-effect sync belongs to the flush thread, which waits for the
+ * edge right before it starts a transfer (flush_thread_start).
+ *
+ * Loop: frame_sched_mark() after each update; wait for input at most
+ * frame_sched_timeout_ms(); when frame_sched_begin() returns 1, render
+ * and flush, or frame_sched_cancel() if the render drew nothing.
+ */
+
+#define FRAME_SCHED_DEFAULT_FPS 30
+
+struct frame_sched_stats {
+    uint64_t updates;       // frame_sched_mark calls
+    uint64_t frames;        // frames begun
+};
+
+int frame_sched_init(int max_fps); //returns -1 if max_fps is not positive
+void frame_sched_mark(void);
+int frame_sched_timeout_ms(int idle_ms);   //idle_ms when nothing is pending
+int frame_sched_begin(void);               //1: render and flush a frame now
+void frame_sched_cancel(void);             //the frame begun had nothing to send: not a frame
+
+void frame_sched_get_stats(struct frame_sched_stats *stats);
+void frame_sched_reset_stats(void);
+
+#endif //FRAME_SCHED_H
@@ -5,8 +5,11 @@ function to shift text rows up
 and framebuffer size tests*/
 
 #include "framebuffer.h"
-#include "font8x16.h"
+#include "glyph_cache.h"
+#include "font_atlas.h"
+#include "utf8.h"
 #include "color_utils.h"
+#include "buffer_pool.h"
 #include "GC9A01.h"
 
 #include <string.h>
@@ -21,61 +24,149 @@ and framebuffer size tests*/
 #include <errno.h>
 #include <stdbool.h>
 
-#define FB_WIDTH 240
-#define FB_HEIGHT 240
-#define FB_BPP 3 //bytes per pixel RGB888
-#define FB_SIZE (FB_WIDTH * FB_HEIGHT * FB_BPP)
-
 #define FONT_WIDTH 8
 #define FONT_HEIGHT 16
 
-#define MAX_ROWS 9
-#define MAX_CHARS 22
-
 #define LOWEST_ROW_Y 177
 #define TOP_ROW_Y 45
 
-//function to draw a character at (x,y) in the framebuffer
-void fb_draw_char(uint8_t *framebuffer, char c, int x, int y,
-                  uint8_t r, uint8_t g, uint8_t b)
-{
-    const uint8_t *char_bitmap = font8x16[(uint8_t)c]; //get pointer to character bitmap (ASCII)
+//region the text renderer owns, fb x 30..210 / y 45..195
+#define TEXT_AREA_X 30
+#define TEXT_AREA_W 181
+#define TEXT_AREA_H 151
 
-    for (int row = 0; row < FONT_HEIGHT; row++) {
-        for (int col = 0; col < FONT_WIDTH; col++) {
+static struct GC9A01_hal_stats last_flush; //transfer cost of the most recent fast flush
+static struct fb_damage damage;            //regions drawn since the last fb_flush_damage
 
-            // check pixel bit
-            if (char_bitmap[row] & (1 << (7 - col))) {
+static uint32_t frame_area(struct GC9A01_frame f) {
+    return (uint32_t)(f.end.X - f.start.X + 1) * (uint32_t)(f.end.Y - f.start.Y + 1);
+}
+
+static struct GC9A01_frame frame_union(struct GC9A01_frame a, struct GC9A01_frame b) {
+    struct GC9A01_frame u = a;
+    if (b.start.X < u.start.X) u.start.X = b.start.X;
+    if (b.start.Y < u.start.Y) u.start.Y = b.start.Y;
+    if (b.end.X > u.end.X) u.end.X = b.end.X;
+    if (b.end.Y > u.end.Y) u.end.Y = b.end.Y;
+    return u;
+}
 
-                // standard coordinate system:
-                int pixel_x = x + col;
-                int pixel_y = y + row;
+//pixels the union of a and b sends that neither of them covers
+static uint32_t merge_waste(struct GC9A01_frame a, struct GC9A01_frame b) {
+    uint32_t covered = frame_area(a) + frame_area(b);
+    int ox = (a.end.X < b.end.X ? a.end.X : b.end.X) - (a.start.X > b.start.X ? a.start.X : b.start.X) + 1;
+    int oy = (a.end.Y < b.end.Y ? a.end.Y : b.end.Y) - (a.start.Y > b.start.Y ? a.start.Y : b.start.Y) + 1;
+    if (ox > 0 && oy > 0) {
+        covered -= (uint32_t)ox * (uint32_t)oy;
+    }
+    return frame_area(frame_union(a, b)) - covered;
+}
 
-                int fb_index = (pixel_y * FB_WIDTH + pixel_x) * FB_BPP;
+static void damage_remove(struct fb_damage *d, int i) {
+    d->rects[i] = d->rects[--d->count];
+}
 
-                framebuffer[fb_index]     = r;
-                framebuffer[fb_index + 1] = g;
-                framebuffer[fb_index + 2] = b;
+//add a panel window to a damage list, merging where a union is cheaper than another window
+void fb_damage_add(struct fb_damage *d, struct GC9A01_frame frame) {
+    //absorb every region that merges cheaply; the union may then absorb more
+    for (int i = 0; i < d->count; i++) {
+        if (merge_waste(d->rects[i], frame) <= FB_DAMAGE_MERGE_SLACK) {
+            frame = frame_union(d->rects[i], frame);
+            damage_remove(d, i);
+            i = -1;
+        }
+    }
+    if (d->count == FB_DAMAGE_MAX) {
+        //list full: fold the new region into the entry where that wastes least
+        int best = 0;
+        uint32_t best_waste = UINT32_MAX;
+        for (int i = 0; i < d->count; i++) {
+            uint32_t w = merge_waste(d->rects[i], frame);
+            if (w < best_waste) {
+                best_waste = w;
+                best = i;
             }
         }
+        frame = frame_union(d->rects[best], frame);
+        damage_remove(d, best);
+    }
+    d->rects[d->count++] = frame;
+
+    //overlapping regions would send more than a full screen: collapse to one window
+    uint32_t total = 0;
+    for (int i = 0; i < d->count; i++) {
+        total += frame_area(d->rects[i]);
+    }
+    if (total > FB_WIDTH * FB_HEIGHT) {
+        for (int i = 1; i < d->count; i++) {
+            d->rects[0] = frame_union(d->rects[0], d->rects[i]);
+        }
+        d->count = 1;
+    }
+}
+
+//record a drawn framebuffer rectangle; frames are in framebuffer coordinates
+void fb_damage_mark(int x, int y, int w, int h) {
+    int x2 = x + w - 1;
+    int y2 = y + h - 1;
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+    if (x2 >= FB_WIDTH) x2 = FB_WIDTH - 1;
+    if (y2 >= FB_HEIGHT) y2 = FB_HEIGHT - 1;
+    if (x > x2 || y > y2) {
+        return;
+    }
+    struct GC9A01_frame frame = {{(uint16_t)x, (uint16_t)y}, {(uint16_t)x2, (uint16_t)y2}};
+    fb_damage_add(&damage, frame);
+}
+
+void fb_damage_take(struct fb_damage *out) {
+    *out = damage;
+    damage.count = 0;
+    damage.scroll_pending = 0;
+}
+
+//send a damage list (only the changed pixels of each region), then its scroll; returns the number of regions
+int fb_flush_damage_list(uint8_t *framebuffer, const struct fb_damage *list) {
+    for (int i = 0; i < list->count; i++) {
+        fb_write_to_gc9a01_fast(framebuffer, list->rects[i]);
     }
+    if (list->scroll_pending) {
+        GC9A01_set_scroll_start(list->scroll_start);
+    }
+    return list->count;
+}
+
+//send everything drawn since the last flush
+int fb_flush_damage(uint8_t *framebuffer) {
+    struct fb_damage pending;
+    fb_damage_take(&pending);
+    return fb_flush_damage_list(framebuffer, &pending);
+}
+
+//function to draw a character at (x,y) in the framebuffer, returns its width
+int fb_draw_char(uint8_t *framebuffer, uint32_t cp, int x, int y,
+                 uint8_t r, uint8_t g, uint8_t b)
+{
+    int w = glyph_draw(framebuffer, cp, x, y, GLYPH_RGB(r, g, b), GLYPH_TRANSPARENT);
+    fb_damage_mark(x, y, w, FONT_HEIGHT);
+    return w;
 }
+//str is UTF-8
 void fb_draw_string(uint8_t *framebuffer, const char *str, int x, int y,
                     uint8_t r, uint8_t g, uint8_t b)
 {
     int orig_x = x;
+    uint32_t cp;
 
-    while (*str) {
+    while ((cp = utf8_decode(&str)) != 0) {
 
-        if (*str == '\n') {
+        if (cp == '\n') {
             x = orig_x;         // reset x (column)
             y += FONT_HEIGHT;   // move down one line
         } else {
-            fb_draw_char(framebuffer, *str, x, y, r, g, b);
-            x += FONT_WIDTH;    // advance horizontally
+            x += fb_draw_char(framebuffer, cp, x, y, r, g, b); // advance horizontally
         }
-
-        str++;
     }
 }
 //function to write a test cross at the point (x,y)
@@ -85,21 +176,162 @@ void fb_draw_test_cross(uint8_t *framebuffer, int x, int y,
         return; //out of bounds
     }
     for (int dx = -5; dx <= 5; dx++) {
-        int fb_index = (y * FB_WIDTH + (x + dx)) * FB_BPP;
         if (x + dx >= 0 && x + dx < FB_WIDTH) {
-            framebuffer[fb_index] = r;
-            framebuffer[fb_index + 1] = g;
-            framebuffer[fb_index + 2] = b;
+            fb_set_pixel(framebuffer, x + dx, y, r, g, b);
         }
     }
     for (int dy = -5; dy <= 5; dy++) {
-        int fb_index = ((y + dy) * FB_WIDTH + x) * FB_BPP;
         if (y + dy >= 0 && y + dy < FB_HEIGHT) {
-            framebuffer[fb_index] = r;
-            framebuffer[fb_index + 1] = g;
-            framebuffer[fb_index + 2] = b;
+            fb_set_pixel(framebuffer, x, y + dy, r, g, b);
+        }
+    }
+    fb_damage_mark(x - 5, y, 11, 1);
+    fb_damage_mark(x, y - 5, 1, 11);
+}
+
+/* Shadow of the panel RAM in framebuffer format. A tile is valid while
+ * the shadow is known to match the panel for every pixel in it; writes
+ * that bypass fb_write_to_gc9a01*() invalidate everything. */
+#define SHADOW_TILE 16
+#define SHADOW_TILES_X ((FB_WIDTH + SHADOW_TILE - 1) / SHADOW_TILE)
+#define SHADOW_TILES_Y ((FB_HEIGHT + SHADOW_TILE - 1) / SHADOW_TILE)
+#define SHADOW_WINDOW_COST FB_DAMAGE_MERGE_SLACK //pixels an extra CASET/RASET/RAMWR is worth
+
+static uint8_t shadow[FB_SIZE];
+static uint16_t shadow_valid[SHADOW_TILES_Y]; //bit tx: tile (tx, ty) matches the panel
+static struct fb_shadow_stats shadow_stats;
+
+void fb_shadow_invalidate(void) {
+    memset(shadow_valid, 0, sizeof(shadow_valid));
+}
+
+//the panel may not show what the shadow holds for frame
+void fb_shadow_invalidate_frame(struct GC9A01_frame frame) {
+    for (int ty = frame.start.Y / SHADOW_TILE; ty <= frame.end.Y / SHADOW_TILE && ty < SHADOW_TILES_Y; ty++) {
+        for (int tx = frame.start.X / SHADOW_TILE; tx <= frame.end.X / SHADOW_TILE && tx < SHADOW_TILES_X; tx++) {
+            shadow_valid[ty] &= (uint16_t)~(1u << tx);
+        }
+    }
+}
+
+//bounding box of the pixels in [x0,x1]x[y0,y1] that differ from the shadow; 0 if none do
+static int shadow_diff(const uint8_t *framebuffer, int x0, int y0, int x1, int y1, struct GC9A01_frame *out) {
+    size_t len = (size_t)(x1 - x0 + 1) * FB_BPP;
+    int found = 0;
+
+    for (int y = y0; y <= y1; y++) {
+        const uint8_t *a = &framebuffer[FB_INDEX(x0, y)];
+        const uint8_t *b = &shadow[FB_INDEX(x0, y)];
+        if (memcmp(a, b, len) == 0) { //libc compares a vector at a time
+            continue;
+        }
+        size_t first = 0, last = len - 1;
+        while (a[first] == b[first]) first++;
+        while (a[last] == b[last]) last--;
+        int fx = x0 + (int)(first / FB_BPP);
+        int lx = x0 + (int)(last / FB_BPP);
+        if (!found) {
+            out->start.X = (uint16_t)fx;
+            out->end.X = (uint16_t)lx;
+            out->start.Y = (uint16_t)y;
+            found = 1;
+        }
+        if (fx < out->start.X) out->start.X = (uint16_t)fx;
+        if (lx > out->end.X) out->end.X = (uint16_t)lx;
+        out->end.Y = (uint16_t)y;
+    }
+    return found;
+}
+
+//windows covering every pixel of frame that differs from what the panel shows
+static void shadow_changes(const uint8_t *framebuffer, struct GC9A01_frame frame, struct fb_damage *out) {
+    out->count = 0;
+    out->scroll_pending = 0;
+
+    for (int ty = frame.start.Y / SHADOW_TILE; ty <= frame.end.Y / SHADOW_TILE; ty++) {
+        int y0 = ty * SHADOW_TILE > frame.start.Y ? ty * SHADOW_TILE : frame.start.Y;
+        int y1 = ty * SHADOW_TILE + SHADOW_TILE - 1 < frame.end.Y ? ty * SHADOW_TILE + SHADOW_TILE - 1 : frame.end.Y;
+        struct GC9A01_frame run;
+        int in_run = 0;
+
+        for (int tx = frame.start.X / SHADOW_TILE; tx <= frame.end.X / SHADOW_TILE; tx++) {
+            int x0 = tx * SHADOW_TILE > frame.start.X ? tx * SHADOW_TILE : frame.start.X;
+            int x1 = tx * SHADOW_TILE + SHADOW_TILE - 1 < frame.end.X ? tx * SHADOW_TILE + SHADOW_TILE - 1 : frame.end.X;
+            struct GC9A01_frame c = {{(uint16_t)x0, (uint16_t)y0}, {(uint16_t)x1, (uint16_t)y1}};
+            int changed = !(shadow_valid[ty] & (1u << tx)) || shadow_diff(framebuffer, x0, y0, x1, y1, &c);
+
+            //neighbouring changed tiles in a band share one window
+            if (changed) {
+                run = in_run ? frame_union(run, c) : c;
+                in_run = 1;
+            } else if (in_run) {
+                fb_damage_add(out, run);
+                in_run = 0;
+            }
+        }
+        if (in_run) {
+            fb_damage_add(out, run);
+        }
+    }
+
+    //one window for the lot when the separate ones cost more
+    if (out->count > 1) {
+        struct GC9A01_frame box = out->rects[0];
+        uint32_t separate = 0;
+        for (int i = 0; i < out->count; i++) {
+            box = frame_union(box, out->rects[i]);
+            separate += frame_area(out->rects[i]) + SHADOW_WINDOW_COST;
+        }
+        if (frame_area(box) + SHADOW_WINDOW_COST <= separate) {
+            out->rects[0] = box;
+            out->count = 1;
+        }
+    }
+}
+
+//the panel now shows these pixels of frame; tiles entirely inside it become valid
+static void shadow_store(const uint8_t *framebuffer, struct GC9A01_frame frame, const struct fb_damage *sent) {
+    for (int i = 0; i < sent->count; i++) {
+        struct GC9A01_frame r = sent->rects[i];
+        size_t len = (size_t)(r.end.X - r.start.X + 1) * FB_BPP;
+        for (int y = r.start.Y; y <= r.end.Y; y++) {
+            memcpy(&shadow[FB_INDEX(r.start.X, y)], &framebuffer[FB_INDEX(r.start.X, y)], len);
+        }
+    }
+    for (int ty = (frame.start.Y + SHADOW_TILE - 1) / SHADOW_TILE; (ty + 1) * SHADOW_TILE - 1 <= frame.end.Y; ty++) {
+        for (int tx = (frame.start.X + SHADOW_TILE - 1) / SHADOW_TILE; (tx + 1) * SHADOW_TILE - 1 <= frame.end.X; tx++) {
+            shadow_valid[ty] |= (uint16_t)(1u << tx);
+        }
+    }
+}
+
+//fill a framebuffer rectangle, clipped, and record it as damaged
+void fb_fill_rect(uint8_t *framebuffer, int x, int y, int w, int h,
+                  uint8_t r, uint8_t g, uint8_t b) {
+    for (int yy = (y < 0 ? 0 : y); yy < y + h && yy < FB_HEIGHT; yy++) {
+        for (int xx = (x < 0 ? 0 : x); xx < x + w && xx < FB_WIDTH; xx++) {
+            fb_set_pixel(framebuffer, xx, yy, r, g, b);
+        }
+    }
+    fb_damage_mark(x, y, w, h);
+}
+
+//copy big-endian RGB565 pixels (panel order, w*h*2 bytes) into the framebuffer; the rectangle must lie inside it
+void fb_blit_rgb565(uint8_t *framebuffer, int x, int y, int w, int h, const uint8_t *pixels) {
+    for (int row = 0; row < h; row++) {
+        const uint8_t *src = &pixels[(size_t)row * (size_t)w * 2];
+#ifdef FB_NATIVE_RGB565
+        memcpy(&framebuffer[FB_INDEX(x, y + row)], src, (size_t)w * 2); //already the framebuffer format
+#else
+        for (int col = 0; col < w; col++) {
+            uint16_t packed = (uint16_t)((src[col * 2] << 8) | src[col * 2 + 1]);
+            uint8_t r5 = packed >> 11, g6 = (packed >> 5) & 0x3F, b5 = packed & 0x1F;
+            fb_set_pixel(framebuffer, x + col, y + row, (uint8_t)((r5 << 3) | (r5 >> 2)),
+                         (uint8_t)((g6 << 2) | (g6 >> 4)), (uint8_t)((b5 << 3) | (b5 >> 2)));
         }
+#endif
     }
+    fb_damage_mark(x, y, w, h);
 }
 
 //unoptimized function to write all framebuffer bytes to GC9A01 within the given frame
@@ -115,14 +347,18 @@ void fb_write_to_gc9a01(uint8_t *framebuffer, struct GC9A01_frame frame) {
     if (x2 > FB_WIDTH) x2 = FB_WIDTH;
     if (y2 > FB_HEIGHT) y2 = FB_HEIGHT;
 
-    /* Column-major stream: step through each column (x) and all rows (y) inside. */
-    for (int x = x1; x < x2; x++) {
-        for (int y = y1; y < y2; y++) {
-            size_t fb_index = (y * FB_HEIGHT + x) * FB_BPP;
+    /* Row-major stream, like the framebuffer: each row (y), then the columns (x) inside. */
+    for (int y = y1; y < y2; y++) {
+        for (int x = x1; x < x2; x++) {
+            size_t fb_index = FB_INDEX(x, y);
+#ifdef FB_NATIVE_RGB565
+            struct GC9A01_color packed = { .bytes = { framebuffer[fb_index], framebuffer[fb_index + 1] }, .len = 2 };
+#else
             uint8_t r = framebuffer[fb_index];
             uint8_t g = framebuffer[fb_index + 1];
             uint8_t b = framebuffer[fb_index + 2];
             struct GC9A01_color packed = rgb_to_16bit(r, g, b);
+#endif
             if (x == x1 && y == y1) {
                 GC9A01_write(packed.bytes, packed.len);
             } else {
@@ -130,141 +366,564 @@ void fb_write_to_gc9a01(uint8_t *framebuffer, struct GC9A01_frame frame) {
             }
         }
     }
+    if (x1 < x2 && y1 < y2) {
+        struct GC9A01_frame sent = {{(uint16_t)x1, (uint16_t)y1}, {(uint16_t)(x2 - 1), (uint16_t)(y2 - 1)}};
+        struct fb_damage whole = { .count = 1, .rects = { sent } };
+        shadow_store(framebuffer, sent, &whole);
+    }
 }
-//optimized function to write all framebuffer bytes to GC9A01 within (x1,x2,y1,y2) using a packed buffer
-//IMPORTANT: define frame as same
-//as long as frame is larger, will work
-//smaller will be more optimized, so if keep index tracking text size, can make faster
-//16 bit color assumed
-void fb_write_to_gc9a01_fast(uint8_t *framebuffer, struct GC9A01_frame frame) {
-    /* GC9A01_frame uses inclusive end coords; convert to exclusive for loops. */
-    int x1 = frame.start.Y;
-    int y1 = frame.start.X;
-    int x2 = frame.end.Y + 1;
-    int y2 = frame.end.X + 1;
+//one address window, packed through a pool buffer unless it can go out in place
+static void fb_send_window(uint8_t *framebuffer, struct GC9A01_frame frame) {
+    uint8_t *packed_buffer = NULL;
+    uint8_t *payload;
+    size_t packed_size;
+
+    GC9A01_set_frame(frame);
+#ifdef FB_NATIVE_RGB565
+    if (frame.start.X == 0 && frame.end.X == FB_WIDTH - 1 && frame.end.Y < FB_HEIGHT) {
+        //full-width rows are contiguous in the native buffer: send in place
+        payload = &framebuffer[FB_INDEX(0, frame.start.Y)];
+        packed_size = (size_t)(frame.end.Y - frame.start.Y + 1) * FB_WIDTH * FB_BPP;
+    } else
+#endif
+    {
+        packed_size = (size_t)(frame.end.X - frame.start.X + 1) * (frame.end.Y - frame.start.Y + 1) * 2; // 2 bytes per pixel in 16-bit format
+        packed_buffer = buffer_pool_get(packed_size);
+        if (!packed_buffer) {
+            return;
+        }
+        packed_size = fb_pack_rgb565(framebuffer, frame, packed_buffer);
+        payload = packed_buffer;
+    }
 
-    if (x1 < 0) x1 = 0;
-    if (y1 < 0) y1 = 0;
-    if (x2 > FB_WIDTH) x2 = FB_WIDTH;
-    if (y2 > FB_HEIGHT) y2 = FB_HEIGHT;
+    // one MEM_WR, then the HAL hands the whole payload to the kernel as one scatter-gather message
+    GC9A01_write(payload, packed_size);
+    buffer_pool_put(packed_buffer);
+}
 
-    size_t total_pixels = (x2 - x1) * (y2 - y1);
-    size_t packed_size = total_pixels * 2; // 2 bytes per pixel in 16-bit format
-    uint8_t *packed_buffer = malloc(packed_size);
-    if (!packed_buffer) {
-        perror("malloc packed_buffer");
-        return;
+/* Round panel: only the inscribed disc is visible. For each row, the
+ * visible columns are those whose pixel centre lies inside the circle. */
+static int disc_clip = 0;
+static uint8_t disc_x0[FB_HEIGHT], disc_x1[FB_HEIGHT]; //visible span of each row, inclusive
+
+void fb_set_disc_clip(int enable) {
+    if (enable && disc_x1[FB_HEIGHT / 2] == 0) {
+        //(2x+1-W)^2 + (2y+1-H)^2 <= W^2, in doubled coordinates to stay integral
+        for (int y = 0; y < FB_HEIGHT; y++) {
+            int dy = 2 * y + 1 - FB_HEIGHT;
+            int x = 0;
+            while ((2 * x + 1 - FB_WIDTH) * (2 * x + 1 - FB_WIDTH) + dy * dy > FB_WIDTH * FB_WIDTH) {
+                x++;
+            }
+            disc_x0[y] = (uint8_t)x;
+            disc_x1[y] = (uint8_t)(FB_WIDTH - 1 - x);
+        }
+    }
+    if (disc_clip != !!enable) {
+        //the shadow holds unsent corner pixels while clipping
+        disc_clip = !!enable;
+        fb_shadow_invalidate();
+    }
+}
+
+//split frame into the cheapest set of row bands hugging the disc (a window costs SHADOW_WINDOW_COST pixels)
+static int disc_bands(struct GC9A01_frame frame, struct GC9A01_frame *bands) {
+    int n = frame.end.Y - frame.start.Y + 1;
+    uint16_t x0[FB_HEIGHT], x1[FB_HEIGHT];
+    uint32_t best[FB_HEIGHT + 1]; //best[j]: cost of sending rows 0..j-1
+    uint16_t cut[FB_HEIGHT + 1];  //first row of the last band in that solution
+
+    for (int r = 0; r < n; r++) {
+        int y = frame.start.Y + r;
+        x0[r] = disc_x0[y] > frame.start.X ? disc_x0[y] : frame.start.X;
+        x1[r] = disc_x1[y] < frame.end.X ? disc_x1[y] : frame.end.X;
     }
 
-    size_t index = 0;
-    /* Match the slow-path ordering: column-major (x outer, y inner). */
-    for (int x = x1; x < x2; x++) {
-        for (int y = y1; y < y2; y++) {
-            size_t fb_index = (y * FB_HEIGHT + x) * FB_BPP;
-            uint8_t r = framebuffer[fb_index];
-            uint8_t g = framebuffer[fb_index + 1];
-            uint8_t b = framebuffer[fb_index + 2];
-            struct GC9A01_color packed = rgb_to_16bit(r, g, b);
-            packed_buffer[index++] = packed.bytes[0];
-            packed_buffer[index++] = packed.bytes[1];
+    //rows are contiguous: the disc covers every row, so bands never need gaps
+    best[0] = 0;
+    for (int j = 1; j <= n; j++) {
+        int lo = FB_WIDTH, hi = -1;
+        best[j] = UINT32_MAX;
+        for (int i = j - 1; i >= 0; i--) {
+            if (x0[i] < lo) lo = x0[i];
+            if (x1[i] > hi) hi = x1[i];
+            uint32_t c = best[i] + SHADOW_WINDOW_COST +
+                         (hi >= lo ? (uint32_t)(hi - lo + 1) * (uint32_t)(j - i) : 0);
+            if (c < best[j]) {
+                best[j] = c;
+                cut[j] = (uint16_t)i;
+            }
+        }
+    }
+
+    //bands come out bottom first; a single band covering the frame's rows is the clipped rectangle, the fallback
+    int count = 0;
+    for (int j = n; j > 0; j = cut[j]) {
+        int lo = FB_WIDTH, hi = -1;
+        for (int r = cut[j]; r < j; r++) {
+            if (x0[r] < lo) lo = x0[r];
+            if (x1[r] > hi) hi = x1[r];
+        }
+        if (hi < lo) {
+            continue; //band lies outside the circle
         }
+        struct GC9A01_frame band = {{(uint16_t)lo, (uint16_t)(frame.start.Y + cut[j])},
+                                    {(uint16_t)hi, (uint16_t)(frame.start.Y + j - 1)}};
+        bands[count++] = band;
     }
+    return count;
+}
 
-    // stream to the panel in 4 KB chunks using MEM_WR then MEM_WR_CONT
-    const size_t chunk_size = 4096;
-    for (size_t offset = 0; offset < packed_size; offset += chunk_size) {
-        size_t bytes_to_write = (offset + chunk_size < packed_size) ? chunk_size : (packed_size - offset);
-        if (offset == 0) {
-            GC9A01_write(&packed_buffer[offset], bytes_to_write);
+//windows that bring frame on the panel up to date, recorded as sent in the shadow
+int fb_shadow_windows(const uint8_t *framebuffer, struct GC9A01_frame frame,
+                      struct GC9A01_frame *windows, int max) {
+    struct fb_damage changes;
+    struct GC9A01_frame bands[FB_HEIGHT];
+    int count = 0;
+
+    if (frame.end.X >= FB_WIDTH) frame.end.X = FB_WIDTH - 1;
+    if (frame.end.Y >= FB_HEIGHT) frame.end.Y = FB_HEIGHT - 1;
+    if (frame.start.X > frame.end.X || frame.start.Y > frame.end.Y) {
+        return 0;
+    }
+    shadow_changes(framebuffer, frame, &changes);
+
+    for (int i = 0; i < changes.count; i++) {
+        struct GC9A01_frame c = changes.rects[i];
+        int n = disc_clip ? disc_bands(c, bands) : 0;
+        //bands only while the plain rectangles still to come keep room (at most FB_DAMAGE_MAX)
+        if (disc_clip && count + n + (changes.count - i - 1) <= max) {
+            uint32_t sent = 0;
+            for (int b = n - 1; b >= 0; b--) {
+                windows[count++] = bands[b];
+                sent += frame_area(bands[b]);
+            }
+            shadow_stats.sent_px += sent;
+            shadow_stats.disc_skipped_px += frame_area(c) - sent;
         } else {
-            GC9A01_write_continue(&packed_buffer[offset], bytes_to_write);
+            windows[count++] = c;
+            shadow_stats.sent_px += frame_area(c);
         }
     }
 
-    //free memory
-    free(packed_buffer);
+    shadow_store(framebuffer, frame, &changes);
+    shadow_stats.flushes++;
+    shadow_stats.windows += (uint64_t)count;
+    shadow_stats.requested_px += frame_area(frame);
+    return count;
+}
+
+/* optimized function to write the framebuffer within frame to GC9A01:
+ * sets its own address windows and sends only the pixels that differ
+ * from what the panel already shows, so any caller can pass a large
+ * frame (even the full screen) and pay only for what changed */
+void fb_write_to_gc9a01_fast(uint8_t *framebuffer, struct GC9A01_frame frame) {
+    struct GC9A01_hal_stats before, after;
+    struct GC9A01_frame windows[FB_SHADOW_WINDOWS_MAX];
+
+    int count = fb_shadow_windows(framebuffer, frame, windows, FB_SHADOW_WINDOWS_MAX);
+
+    GC9A01_get_hal_stats(&before);
+    for (int i = 0; i < count; i++) {
+        fb_send_window(framebuffer, windows[i]);
+    }
+    GC9A01_get_hal_stats(&after);
+    last_flush.syscalls = after.syscalls - before.syscalls;
+    last_flush.dc_toggles = after.dc_toggles - before.dc_toggles;
+    last_flush.bytes = after.bytes - before.bytes;
+    last_flush.transfer_ns = after.transfer_ns - before.transfer_ns;
+}
+
+void fb_get_shadow_stats(struct fb_shadow_stats *stats) {
+    *stats = shadow_stats;
+}
+
+void fb_reset_shadow_stats(void) {
+    struct fb_shadow_stats zero = {0};
+    shadow_stats = zero;
+}
 
+//syscalls, D/C toggles, bytes and SPI time of the last fb_write_to_gc9a01_fast call
+void fb_get_flush_stats(struct GC9A01_hal_stats *stats) {
+    *stats = last_flush;
 }
+
 //clear framebuffer to black
 void fb_clear(uint8_t *framebuffer) {
     memset(framebuffer, 0x00, FB_SIZE);
+    damage.count = 0;
+    fb_damage_mark(0, 0, FB_WIDTH, FB_HEIGHT);
 }
 
 //Internal string management: keep track of existing rows and their contents. Write entire contents to framebuffer once per cycle.
 
-static char lines[MAX_ROWS][MAX_CHARS + 1]; // +1 for null terminator
-static int current_row = 0;
+/* Rows are cells of code points, 0-terminated. A wide (16 px) glyph takes
+ * two cells, the second holding CELL_TAIL, so a row never holds more than
+ * MAX_CHARS cells' worth of pixels. */
+#define CELL_TAIL 0x110000u //right half of a wide glyph, past the last code point
+
+typedef uint32_t text_row[MAX_CHARS + 1]; // +1 for null terminator
+
+/* Rows live in a ring: the newest row is ring[head], older ones follow
+ * backwards, and a line break only moves head. The ring holds the
+ * MAX_ROWS on screen plus the scrollback, in one arena allocated up
+ * front (the static one unless textbuffer_set_scrollback resized it). */
+static text_row default_arena[MAX_ROWS + TEXT_SCROLLBACK_DEFAULT];
+static text_row *ring = default_arena;
+static int ring_rows = MAX_ROWS + TEXT_SCROLLBACK_DEFAULT;
+static int head = 0;        //ring index of the lowest row, lines(0)
+static int history = 0;     //rows above the screen that can be paged back to
+static int view_offset = 0; //rows the view is paged back, 0: live
+
+//layout state, carried from one write to the next
+static int cursor = 0;                  //cells used in the lowest row
+static int word_start = -1;             //cell the word being laid out starts at, -1 between words
+static struct utf8_stream utf8_state;
+
+//row k counted up from the newest, 0 is the lowest row on screen when live
+static uint32_t *lines(int k) {
+    int i = head - k;
+    return ring[i < 0 ? i + ring_rows : i];
+}
+
+//screen y of each row, row 0 is the lowest string on screen
+static const int row_y[MAX_ROWS] = { LOWEST_ROW_Y, 161, 141, 125, 109, 93, 77, 61, TOP_ROW_Y };
+static uint32_t drawn[MAX_ROWS][MAX_CHARS + 1]; //what each row currently shows in the framebuffer
+static int text_area_stale = 1;             //text area may hold pixels the renderer didn't draw
+static const uint8_t *drawn_target;         //the buffer drawn[] describes
+static uint32_t text_fg = GLYPH_RGB(0, 255, 0); //green text
+static uint32_t text_bg = GLYPH_RGB(0, 0, 0);
+
+/* Hardware scroll mode: rows sit on an even FONT_HEIGHT pitch inside a
+ * panel scroll area, and the framebuffer band holds them as a ring in
+ * panel memory order. A new line moves the scroll start by one row and
+ * redraws only the band that wrapped around to the bottom. */
+#define SCROLL_TOP_Y (LOWEST_ROW_Y - (MAX_ROWS - 1) * FONT_HEIGHT)
+#define SCROLL_LINES (MAX_ROWS * FONT_HEIGHT)
+
+static int hw_scroll = 0;
+static int scroll_off = 0;       //ring offset of the scroll area, in lines
+static int pending_scrolls = 0;  //shift_ups not yet applied to the panel
+
+static size_t cells_len(const uint32_t *cells) {
+    size_t n = 0;
+    while (cells[n]) {
+        n++;
+    }
+    return n;
+}
+
+static int cells_equal(const uint32_t *a, const uint32_t *b) {
+    for (; *a == *b; a++, b++) {
+        if (!*a) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//text cells code point cp takes
+static int cell_width(uint32_t cp) {
+    return font_atlas_glyph(cp, NULL) > FONT_WIDTH ? 2 : 1;
+}
 
 void textbuffer_initialize() {
-    memset(lines, 0, sizeof(lines));
-    current_row = 0;
+    memset(ring, 0, sizeof(text_row) * (size_t)ring_rows);
+    head = 0;
+    history = 0;
+    view_offset = 0;
+    cursor = 0;
+    word_start = -1;
+    memset(&utf8_state, 0, sizeof(utf8_state));
+    text_area_stale = 1;
+    pending_scrolls = 0;
+}
+
+int textbuffer_set_scrollback(int rows) {
+    if (rows < 0) {
+        rows = 0;
+    }
+    if (rows > TEXT_SCROLLBACK_MAX) {
+        fprintf(stderr, "scrollback of %d rows is over the %d row limit\n", rows, TEXT_SCROLLBACK_MAX);
+        return -1;
+    }
+    if (rows + MAX_ROWS == ring_rows) {
+        return 0;
+    }
+    text_row *arena = default_arena;
+    if (rows > TEXT_SCROLLBACK_DEFAULT) {
+        arena = malloc(sizeof(text_row) * (size_t)(MAX_ROWS + rows));
+        if (!arena) {
+            perror("malloc scrollback");
+            return -1;
+        }
+    }
+    if (ring != default_arena) {
+        free(ring);
+    }
+    ring = arena;
+    ring_rows = MAX_ROWS + rows;
+    textbuffer_initialize(); //drops the text, like a resized terminal would
+    return 0;
+}
+
+int textbuffer_scroll_view(int rows) {
+    int offset = view_offset + rows;
+    if (offset < 0) {
+        offset = 0;
+    }
+    if (offset > history) {
+        offset = history;
+    }
+    if (offset != view_offset) {
+        view_offset = offset;
+        pending_scrolls = 0; //not the live rows any more: the row diff redraws what moved
+    }
+    return view_offset;
+}
+
+//framebuffer y a row is drawn at
+static int text_row_y(int row) {
+    if (!hw_scroll) {
+        return row_y[row];
+    }
+    int y = LOWEST_ROW_Y - row * FONT_HEIGHT;
+    return SCROLL_TOP_Y + (y - SCROLL_TOP_Y + scroll_off) % SCROLL_LINES;
+}
+
+int textbuffer_set_hw_scroll(int enable) {
+    if (enable) {
+        //rows are framebuffer y: gate lines only without MV, and top-down only without MY
+        uint8_t madctl = GC9A01_get_madctl();
+        if ((madctl & (0x20 | 0x80)) != 0) {
+            fprintf(stderr, "hardware scroll needs text rows on gate lines, top-down (MADCTL %02x has MV or MY)\n",
+                    madctl);
+            return -1;
+        }
+        GC9A01_set_scroll_area(SCROLL_TOP_Y, SCROLL_LINES, FB_HEIGHT - SCROLL_TOP_Y - SCROLL_LINES);
+        GC9A01_set_scroll_start(SCROLL_TOP_Y);
+    } else if (hw_scroll) {
+        GC9A01_set_scroll_area(0, FB_HEIGHT, 0);
+        GC9A01_set_scroll_start(0);
+    }
+    hw_scroll = enable;
+    scroll_off = 0;
+    pending_scrolls = 0;
+    text_area_stale = 1; //the layout changed, redraw everything once
+    return 0;
 }   
 
-//shift all lines up by one, dropping the top line without populating a new line
+//shift all lines up by one, moving the top line into scrollback (the oldest scrollback line is dropped)
 //leaves a blank line at the bottom
 void textbuffer_shift_up() {
-    for (int i = MAX_ROWS - 1; i >= 1; i--) {
-        strncpy(lines[i], lines[i - 1], MAX_CHARS + 1);
+    if (history < ring_rows - MAX_ROWS) {
+        history++;
+    }
+    if (view_offset > 0) {
+        //paged back: keep showing the same rows while there is history to hold them
+        if (view_offset < history) {
+            view_offset++;
+        }
+    } else if (hw_scroll) {
+        pending_scrolls++;
     }
+    head = head + 1 == ring_rows ? 0 : head + 1;
     //clear the lowest line
-    memset(lines[0], 0, MAX_CHARS + 1);
+    memset(lines(0), 0, sizeof(text_row));
+    cursor = 0;
+    word_start = -1;
 }
 
-//function to check incoming string data over socket and receive into buffer while appending the part that fits to the lowest available row, adding lines as needed
-void fb_receive_and_update_text(uint8_t *framebuffer, char receive_buffer[]) {
-    //assumes null-terminated string in receive_buffer
-    //recursive function
-    //check if the string doesn't fit in the current line
-    size_t bytes_received = strlen(receive_buffer);
-    char recursive_buffer[1024];
-    //debug print
-    printf("Received string of length %zu: %s\n", bytes_received, receive_buffer);
-
-    size_t space_left = MAX_CHARS - strlen(lines[0]);
-    //debug print
-    printf("Space left in current line: %zu\n", space_left);
-    if (space_left < bytes_received) {
-        //fits exactly or overflows
-        //append what fits
-        strncat(lines[0], receive_buffer, space_left);
-        //shift up
+/* Layout: one pass over the input, no lookahead. Words are laid out as
+ * they arrive; when one no longer fits, the part already placed moves
+ * down to a fresh row, unless it started the row, in which case it is
+ * hard-broken there. Spaces collapse and never start a row. */
+
+//start a new row; carry: move the word in progress down with it
+static void layout_break(int carry) {
+    uint32_t *old = lines(0);
+    int from = word_start, to = cursor;
+
+    textbuffer_shift_up();
+    if (carry && from > 0) {
+        memcpy(lines(0), &old[from], sizeof(uint32_t) * (size_t)(to - from));
+        cursor = to - from;
+        //drop the word and the space before it from the row above
+        while (from > 0 && old[from - 1] == ' ') {
+            from--;
+        }
+        old[from] = 0;
+    }
+    word_start = 0;
+}
+
+static void layout_put(uint32_t cp) {
+    uint32_t *row = lines(0);
+
+    if (cp == '\n') {
         textbuffer_shift_up();
-        //prepare leftover string
-        strncpy(recursive_buffer, receive_buffer + space_left, bytes_received - space_left + 1);
-        //recurse with leftovers
-        fb_receive_and_update_text(framebuffer, recursive_buffer);
-        //debug print
-        printf("Recursed with leftover string: %s\n", recursive_buffer);
-        return;
-    } else if (space_left == bytes_received) {
-        //fits exactly
-        strncat(lines[0], receive_buffer, bytes_received);
-        //shift up for next line
-        textbuffer_shift_up(); //no need for a space append here.
         return;
     }
-    else {
-        //fits with space left
-        strncat(lines[0], receive_buffer, bytes_received);
-        //requires appending a space assuming next input starts with a word
-        strncat(lines[0], " ", 1);
+    if (cp == ' ' || cp == '\t') {
+        word_start = -1;
+        if (cursor > 0 && cursor < MAX_CHARS && row[cursor - 1] != ' ') {
+            row[cursor++] = ' ';
+            row[cursor] = 0;
+        }
         return;
     }
+    if (cp < ' ') {
+        return; //other control characters have no glyph worth showing
+    }
+
+    int w = cell_width(cp);
+    if (word_start < 0) {
+        word_start = cursor;
+    }
+    if (cursor + w > MAX_CHARS) {
+        layout_break(1);
+        if (cursor + w > MAX_CHARS) {
+            layout_break(0); //carried word fills the row: hard break
+        }
+        row = lines(0);
+    }
+    row[cursor++] = cp;
+    if (w == 2) {
+        row[cursor++] = CELL_TAIL;
+    }
+    row[cursor] = 0;
+}
+
+void textbuffer_write(const char *text, size_t len) {
+    uint32_t cps[2];
+    for (size_t i = 0; i < len; i++) {
+        int n = utf8_stream_feed(&utf8_state, (uint8_t)text[i], cps);
+        for (int k = 0; k < n; k++) {
+            layout_put(cps[k]);
+        }
+    }
+}
+
+//function to append incoming string data from the socket to the text rows, adding lines as needed
+//receive_buffer is one UTF-8 datagram; senders send whole words, so a datagram also ends a word
+void fb_receive_and_update_text(uint8_t *framebuffer, char receive_buffer[]) {
+    (void)framebuffer; //drawn by textbuffer_render
+    textbuffer_write(receive_buffer, strlen(receive_buffer));
+    textbuffer_write(" ", 1);
+}
+
+int textbuffer_replace_row(int row, const char *text, size_t len) {
+    if (row < 0 || row >= MAX_ROWS) {
+        return -1;
+    }
+    uint32_t *cells = lines(row);
+    struct utf8_stream st = {0};
+    uint32_t cps[2];
+    int n = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        int got = utf8_stream_feed(&st, (uint8_t)text[i], cps);
+        for (int k = 0; k < got; k++) {
+            if (cps[k] < ' ') {
+                continue; //a row holds no line breaks
+            }
+            int w = cell_width(cps[k]);
+            if (n + w > MAX_CHARS) {
+                goto full; //the rest is cut off
+            }
+            cells[n++] = cps[k];
+            if (w == 2) {
+                cells[n++] = CELL_TAIL;
+            }
+        }
+    }
+full:
+    cells[n] = 0;
+    if (row == 0) {
+        //appends continue after the new contents
+        cursor = n;
+        word_start = -1;
+    }
+    return 0;
+}
+
+void textbuffer_set_color(uint32_t fg, uint32_t bg) {
+    if (fg != text_fg || bg != text_bg) {
+        text_fg = fg;
+        text_bg = bg;
+        text_area_stale = 1; //every row in the new colours
+    }
+}
+
+//fill a framebuffer rectangle with the text background, clipped, and record it as damaged
+static void fb_clear_rect(uint8_t *framebuffer, int x, int y, int w, int h) {
+    fb_fill_rect(framebuffer, x, y, w, h, (uint8_t)(text_bg >> 16), (uint8_t)(text_bg >> 8), (uint8_t)text_bg);
+}
+
+//bring one row from its drawn contents to text, touching only the glyph cells that differ
+static void textbuffer_render_row(uint8_t *framebuffer, int row, const uint32_t *text) {
+    const uint32_t *old = drawn[row];
+    int y = text_row_y(row);
+
+    size_t old_len = cells_len(old);
+    size_t new_len = cells_len(text);
+    size_t n = old_len > new_len ? old_len : new_len;
+    for (size_t j = 0; j < n; j++) {
+        uint32_t o = j < old_len ? old[j] : ' ';
+        uint32_t c = j < new_len ? text[j] : ' ';
+        //a wide glyph's right half changes only along with its left half, drawn there
+        if (o == c || c == CELL_TAIL) {
+            continue;
+        }
+        int x = TEXT_AREA_X + (int)j * FONT_WIDTH;
+        if (c == ' ') {
+            fb_clear_rect(framebuffer, x, y, FONT_WIDTH, FONT_HEIGHT);
+        } else {
+            //opaque glyph: its background replaces whatever the cell held
+            int w = glyph_draw(framebuffer, c, x, y, text_fg, text_bg);
+            fb_damage_mark(x, y, w, FONT_HEIGHT);
+        }
+    }
 }
 
 void textbuffer_render(uint8_t *framebuffer) {
-    fb_clear(framebuffer);
-
-    //render the entire framebuffer from text lines
-    fb_draw_string(framebuffer, lines[0], 30, 177, 0, 255, 0); //lowest string on screen
-	fb_draw_string(framebuffer, lines[1], 30, 161, 0, 255, 0); //green text
-	fb_draw_string(framebuffer, lines[2], 30, 141, 0, 255, 0); //green text
-	fb_draw_string(framebuffer, lines[3], 30, 125, 0, 255, 0); //green text
-	fb_draw_string(framebuffer, lines[4], 30, 109, 0, 255, 0); //green text
-	fb_draw_string(framebuffer, lines[5], 30, 93, 0, 255, 0); //green text
-	fb_draw_string(framebuffer, lines[6], 30, 77, 0, 255, 0); //green text
-	fb_draw_string(framebuffer, lines[7], 30, 61, 0, 255, 0); //green text
-	fb_draw_string(framebuffer, lines[8], 30, 45, 0, 255, 0); //highest string on screen
+    if (framebuffer != drawn_target) {
+        text_area_stale = 1; //e.g. moved into a compositor layer: drawn[] is about the old buffer
+        drawn_target = framebuffer;
+    }
+    if (text_area_stale) {
+        //other drawing may have used the text area: start from a blank region
+        fb_clear_rect(framebuffer, TEXT_AREA_X, TOP_ROW_Y, TEXT_AREA_W, TEXT_AREA_H);
+        memset(drawn, 0, sizeof(drawn));
+        text_area_stale = 0;
+        pending_scrolls = 0;
+    }
+
+    //past MAX_ROWS every row is new anyway
+    if (pending_scrolls > MAX_ROWS) {
+        pending_scrolls = MAX_ROWS;
+    }
+    for (; pending_scrolls > 0; pending_scrolls--) {
+        //blank the top row's band, then rotate it round to become the bottom row
+        int w = (int)cells_len(drawn[MAX_ROWS - 1]) * FONT_WIDTH;
+        if (w > 0) {
+            fb_clear_rect(framebuffer, TEXT_AREA_X, text_row_y(MAX_ROWS - 1), w, FONT_HEIGHT);
+        }
+        scroll_off = (scroll_off + FONT_HEIGHT) % SCROLL_LINES;
+        memmove(drawn[1], drawn[0], sizeof(drawn[0]) * (MAX_ROWS - 1));
+        memset(drawn[0], 0, sizeof(drawn[0]));
+        damage.scroll_pending = 1;
+        damage.scroll_start = (uint16_t)(SCROLL_TOP_Y + scroll_off);
+    }
+
+    //only rows whose contents changed since the last render cost anything
+    for (int i = 0; i < MAX_ROWS; i++) {
+        const uint32_t *text = lines(view_offset + i);
+        if (!cells_equal(drawn[i], text)) {
+            textbuffer_render_row(framebuffer, i, text);
+            memcpy(drawn[i], text, sizeof(drawn[i]));
+        }
+    }
 }
 
 
@@ -6,23 +6,153 @@
 #include <stddef.h>
 #include "GC9A01.h"
 
+#define FB_WIDTH 240
+#define FB_HEIGHT 240
 
+/* Pixel format, chosen at build time (make FB_FORMAT=rgb565):
+ * RGB888, or big-endian RGB565 exactly as the panel consumes it, so a
+ * flush is a plain copy with no conversion. Both are row-major, the
+ * order the panel streams in (orientation is handled by MADCTL). */
+#ifdef FB_NATIVE_RGB565
+#define FB_BPP 2 //bytes per pixel RGB565
+#else
+#define FB_BPP 3 //bytes per pixel RGB888
+#endif
+#define FB_INDEX(x, y) (((size_t)(y) * FB_WIDTH + (size_t)(x)) * FB_BPP)
+#define FB_SIZE (FB_WIDTH * FB_HEIGHT * FB_BPP)
+
+static inline void fb_set_pixel(uint8_t *framebuffer, int x, int y,
+                                uint8_t r, uint8_t g, uint8_t b)
+{
+    uint8_t *p = &framebuffer[FB_INDEX(x, y)];
+#ifdef FB_NATIVE_RGB565
+    uint16_t packed = (uint16_t)(((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3));
+    p[0] = (uint8_t)(packed >> 8);
+    p[1] = (uint8_t)(packed & 0xFF);
+#else
+    p[0] = r;
+    p[1] = g;
+    p[2] = b;
+#endif
+}
+
+//RGB565 channels are widened by bit replication, so white reads back as 255
+static inline void fb_get_pixel(const uint8_t *framebuffer, int x, int y,
+                                uint8_t *r, uint8_t *g, uint8_t *b)
+{
+    const uint8_t *p = &framebuffer[FB_INDEX(x, y)];
+#ifdef FB_NATIVE_RGB565
+    uint16_t packed = (uint16_t)((p[0] << 8) | p[1]);
+    uint8_t r5 = packed >> 11, g6 = (packed >> 5) & 0x3F, b5 = packed & 0x1F;
+    *r = (uint8_t)((r5 << 3) | (r5 >> 2));
+    *g = (uint8_t)((g6 << 2) | (g6 >> 4));
+    *b = (uint8_t)((b5 << 3) | (b5 >> 2));
+#else
+    *r = p[0];
+    *g = p[1];
+    *b = p[2];
+#endif
+}
+
+/* Damage tracking: every fb_draw_* primitive and the text renderer record
+ * the panel window they touched. Regions are kept as GC9A01 frames and
+ * merged whenever sending the union costs fewer extra pixels than a
+ * separate address window would; when the list is full the cheapest pair
+ * is merged. fb_flush_damage sends only what changed since the last flush. */
+#define FB_DAMAGE_MAX 8             //regions before the cheapest pair is merged
+#define FB_DAMAGE_MERGE_SLACK 256   //extra pixels worth sending to save a window
 
-void fb_draw_char(uint8_t *framebuffer, char c, int x, int y, 
-                 uint8_t r, uint8_t g, uint8_t b);
+struct fb_damage {
+    int count;
+    struct GC9A01_frame rects[FB_DAMAGE_MAX];
+    int scroll_pending;     //issue scroll_start after the windows (hardware scroll mode)
+    uint16_t scroll_start;
+};
+
+void fb_damage_add(struct fb_damage *damage, struct GC9A01_frame frame);
+void fb_damage_mark(int x, int y, int w, int h); //framebuffer coords, clipped
+void fb_damage_take(struct fb_damage *out);      //move out the pending damage
+int fb_flush_damage(uint8_t *framebuffer);
+int fb_flush_damage_list(uint8_t *framebuffer, const struct fb_damage *list);
+
+//text is UTF-8; code points come from the font atlas (font_atlas.h), ASCII from font8x16
+int fb_draw_char(uint8_t *framebuffer, uint32_t cp, int x, int y,
+                 uint8_t r, uint8_t g, uint8_t b);  //returns the glyph width
 void fb_draw_string(uint8_t *framebuffer, const char *str, int x, int y, 
                    uint8_t r, uint8_t g, uint8_t b);
 void fb_draw_test_cross(uint8_t *framebuffer, int x, int y, 
                        uint8_t r, uint8_t g, uint8_t b);
+void fb_fill_rect(uint8_t *framebuffer, int x, int y, int w, int h,
+                  uint8_t r, uint8_t g, uint8_t b);
+void fb_blit_rgb565(uint8_t *framebuffer, int x, int y, int w, int h, const uint8_t *pixels); //big-endian, unclipped
 void fb_write_to_gc9a01(uint8_t *framebuffer, struct GC9A01_frame frame);
 void fb_write_to_gc9a01_fast(uint8_t *framebuffer, struct GC9A01_frame frame);
+size_t fb_pack_rgb565(const uint8_t *framebuffer, struct GC9A01_frame frame, uint8_t *packed_buffer);
 void fb_clear(uint8_t *framebuffer);
+void fb_get_flush_stats(struct GC9A01_hal_stats *stats);
+
+/* Both fb_write_to_gc9a01* calls and the flush thread keep a shadow copy
+ * of the panel RAM; the fast paths diff frame against it in 16x16 tiles
+ * and send only the changed pixels, in as few windows as pays off.
+ * Anything else that writes the panel (splash asset, SPI calibration,
+ * MADCTL changes) must call fb_shadow_invalidate(). */
+struct fb_shadow_stats {
+    uint64_t flushes;         // frames diffed against the shadow
+    uint64_t windows;         // address windows actually sent
+    uint64_t requested_px;    // pixels in the frames asked for
+    uint64_t sent_px;         // pixels that went out, or were queued to the flush thread
+    uint64_t disc_skipped_px; // changed pixels left out because they lie outside the disc
+};
+
+void fb_shadow_invalidate(void);
+void fb_shadow_invalidate_frame(struct GC9A01_frame frame); //e.g. planned windows that were never sent
+/* Round panel: only the 240x240 inscribed disc is visible. With disc clip
+ * on, both fast paths send each changed region as row bands hugging the
+ * circle, or as the plain rectangle when the extra windows cost more. */
+void fb_set_disc_clip(int enable);
+/* The windows covering the pixels of frame that differ from the panel,
+ * as disc bands when clipping; at most max, which must be FB_DAMAGE_MAX
+ * or more (bands past max fall back to rectangles). The shadow records
+ * them as sent, so the caller must send them, packed from this
+ * framebuffer state. */
+#define FB_SHADOW_WINDOWS_MAX 64
+int fb_shadow_windows(const uint8_t *framebuffer, struct GC9A01_frame frame,
+                      struct GC9A01_frame *windows, int max);
+void fb_get_shadow_stats(struct fb_shadow_stats *stats);
+void fb_reset_shadow_stats(void);
 
 //Internal string management functions
+#define MAX_ROWS 9                  //text rows on screen
+#define MAX_CHARS 22                //cells per row
+#define TEXT_SCROLLBACK_DEFAULT 64  //rows kept above the screen
+#define TEXT_SCROLLBACK_MAX 4096    //rows; ~370 KB of text
+
 void textbuffer_initialize();
+/* Rows that scroll off the top are kept, up to rows of them, in an arena
+ * allocated here once; text is then stored and scrolled without copying
+ * or allocating. Clears the text buffer. Returns -1 if rows is over
+ * TEXT_SCROLLBACK_MAX or out of memory. */
+int textbuffer_set_scrollback(int rows);
+/* Page the view back (rows > 0) or forward through the scrollback; new
+ * text doesn't move a paged-back view. Returns the rows now paged back,
+ * 0 meaning live. Takes effect on the next textbuffer_render. */
+int textbuffer_scroll_view(int rows);
 void textbuffer_shift_up();
-void fb_receive_and_update_text(uint8_t *framebuffer, char receive_buffer[]);
+/* Lay UTF-8 text out onto the rows in one pass: words wrap whole, only
+ * words longer than a row are broken, '\n' starts a new row. Input is a
+ * byte stream, so words and UTF-8 sequences may span writes. */
+void textbuffer_write(const char *text, size_t len);
+void fb_receive_and_update_text(uint8_t *framebuffer, char receive_buffer[]); //one datagram: writes it and ends the word
+/* Set row (0: lowest on screen, live view) to text, UTF-8, cut at MAX_CHARS
+ * cells. Returns -1 for a row off the screen. */
+int textbuffer_replace_row(int row, const char *text, size_t len);
+void textbuffer_set_color(uint32_t fg, uint32_t bg);  //GLYPH_RGB values; redraws the text area
 void textbuffer_render(uint8_t *framebuffer);
+/* Scroll the text area with the panel's vertical scroll instead of
+ * redrawing it; only possible when text rows lie along gate lines
+ * top-down (no MV or MY, e.g. rotation 0). Sends commands: call while owning the SPI
+ * device. Returns -1, and keeps software scrolling, when unsupported. */
+int textbuffer_set_hw_scroll(int enable);
 
 
 #endif
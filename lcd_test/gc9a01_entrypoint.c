@@ -9,43 +9,25 @@
 #include "socket_rx.h"
 #include "framebuffer.h"
 #include "startscreen.h"
+#include "bench.h"
+#include "flush_thread.h"
+#include "spi_autotune.h"
+#include "splash.h"
+#include "buffer_pool.h"
+#include "frame_sched.h"
+#include "widget.h"
+#include "font_atlas.h"
+#include "event_loop.h"
+#include "protocol.h"
 
 #include <stdint.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <getopt.h>
-#include <fcntl.h>
-#include <sys/ioctl.h>
-#include <sys/wait.h>
-#include <linux/types.h>
-#include <linux/spi/spidev.h>
-#include <math.h>
 #include <string.h>
 
-#include <gpiod.h>
 
-//define LINE NUMBERS <-> 40 pin hdr pins used by GPIO
-#define RES 106
-#define DC 105
-//define display parameters for screen text
-#define MAX_ROWS 10
-#define MAX_CHARS 22
-
-
-static const char *device = "/dev/spidev0.0";
-static uint8_t mode = 0;
-static uint8_t bits = 8;
-static uint32_t speed = 5000000;
-static uint16_t delay = 0;
-const char *chipname = "/dev/gpiochip0";
-static const char *pinmux_script = "sh ./pinmux_setup.sh";
-
-static struct gpiod_chip *chip;
-static struct gpiod_line *line1;
-static struct gpiod_line *line2;
-
-int spi_fd;
 
 int stop_pin = 0; //use for hardware interrupt stop later on
 int stop_counter = 0; //use for testing
@@ -58,237 +40,200 @@ static void pabort(const char *s){
     abort();
 }
 
-static int run_pinmux(void) {
-	int ret = system(pinmux_script);
-	if (ret == -1) {
-		perror("system(pinmux)");
-		return -1;
-	}
-
-	if (WIFEXITED(ret) && WEXITSTATUS(ret) == 0) {
-		return 0;
-	}
-
-	fprintf(stderr, "pinmux script exited with status %d\n", WEXITSTATUS(ret));
-	return -1;
-}
-
-
-int spi_init(){
-    int ret = 0;
-
-    spi_fd = open(device, O_RDWR);
-    if (spi_fd < 0) {
-        perror("can't open device");
-        return -1;
-    }
-
-    //setting SPI mode
-    ret = ioctl(spi_fd, SPI_IOC_WR_MODE, &mode);
-    if (ret == -1)
-        goto fail;
-
-    ret = ioctl(spi_fd, SPI_IOC_RD_MODE, &mode);
-    if (ret == -1)
-        goto fail;
-    /*
-	 * bits per word
-	 */
-	ret = ioctl(spi_fd, SPI_IOC_WR_BITS_PER_WORD, &bits);
-	if (ret == -1)
-		goto fail;
-
-	ret = ioctl(spi_fd, SPI_IOC_RD_BITS_PER_WORD, &bits);
-	if (ret == -1)
-		goto fail;
-
-	/*
-	 * max speed hz
-	 */
-	ret = ioctl(spi_fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed);
-	if (ret == -1)
-		goto fail;
-
-	ret = ioctl(spi_fd, SPI_IOC_RD_MAX_SPEED_HZ, &speed);
-	if (ret == -1)
-		goto fail;
-
-	printf("spi mode: %d\n", mode);
-	printf("bits per word: %d\n", bits);
-	printf("max speed: %d Hz (%d KHz)\n", speed, speed/1000);
-
-	return ret;
-fail:
-	perror("spi config");
-	if (spi_fd >= 0) {
-		close(spi_fd);
-		spi_fd = -1;
+//socket datagram: text or binary commands; rendering waits for the next frame
+static void on_datagram(void *ctx, char *data, size_t len) {
+	if (len > 0 && (uint8_t)data[0] == PROTO_MAGIC) {
+		printf("Received %zu bytes of commands\n", len);
+	} else {
+		printf("Received %zu bytes: %s\n", len, data);
 	}
-	return -1;
-
+	proto_handle(ctx, data, len);
 }
 
-void GC9A01_set_reset(uint8_t val){
-	if (line2) {
-		gpiod_line_set_value(line2, val);
-	}
+static void usage(const char *prog) {
+	printf("usage: %s [options]\n"
+	       "  -b, --bench      run render/flush benchmarks and exit\n"
+	       "  -c, --calibrate  tune SPI transfer size and clock, save to " SPI_PROFILE_PATH "\n"
+	       "  -w, --warm       skip panel reset/init if it is already configured\n"
+	       "  -s, --hw-scroll  scroll text with the panel's vertical scroll; needs -r 0 (or -r 2 -y),\n"
+	       "                   and drops the battery gauge, which would scroll with the text\n"
+	       "  -r, --rotate N   rotate the image N clockwise quarter turns (default 1)\n"
+	       "  -x, --mirror-x   mirror the image horizontally\n"
+	       "  -y, --mirror-y   mirror the image vertically\n"
+	       "  -d, --disc       send only pixels inside the round panel's visible circle\n"
+	       "  -f, --fps N      flush text updates at most N times a second (default %d)\n"
+	       "  -t, --te LINE    start each flush on the panel's TE edge, read from GPIO LINE\n"
+	       "  -k, --scrollback N  keep N text rows above the screen (default %d, at most %d)\n"
+	       "  -R, --rcvbuf N   socket receive buffer in bytes (default %d, 0: kernel default)\n"
+	       "  -h, --help       show this help\n", prog, FRAME_SCHED_DEFAULT_FPS, TEXT_SCROLLBACK_DEFAULT,
+	       TEXT_SCROLLBACK_MAX, SOCKET_RCVBUF_DEFAULT);
 }
 
-void GC9A01_set_data_command(uint8_t val){
-	if (line1) {
-		gpiod_line_set_value(line1, val);
-	}
-}
-
-void GC9A01_spi_tx(uint8_t *data, size_t len){
-	const size_t chunk_size = 4096; // conservative max transfer size for Jetson kernel
-
-	for (size_t offset = 0; offset < len; offset += chunk_size) {
-		size_t this_len = (len - offset < chunk_size) ? (len - offset) : chunk_size;
-
-		struct spi_ioc_transfer tr = {
-			.tx_buf = (unsigned long)(data + offset),
-			.rx_buf = 0,
-			.len = this_len,
-			.delay_usecs = delay,
-			.speed_hz = speed,
-			.bits_per_word = bits,
-		};
+//program entrypoint
 
-		if (ioctl(spi_fd, SPI_IOC_MESSAGE(1), &tr) < 1) {
-			pabort("can't send spi message");
+int main(int argc, char **argv) {
+
+	static const struct option long_opts[] = {
+		{ "bench", no_argument, NULL, 'b' },
+		{ "calibrate", no_argument, NULL, 'c' },
+		{ "warm", no_argument, NULL, 'w' },
+		{ "hw-scroll", no_argument, NULL, 's' },
+		{ "rotate", required_argument, NULL, 'r' },
+		{ "mirror-x", no_argument, NULL, 'x' },
+		{ "mirror-y", no_argument, NULL, 'y' },
+		{ "disc", no_argument, NULL, 'd' },
+		{ "fps", required_argument, NULL, 'f' },
+		{ "te", required_argument, NULL, 't' },
+		{ "scrollback", required_argument, NULL, 'k' },
+		{ "rcvbuf", required_argument, NULL, 'R' },
+		{ "help",  no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 },
+	};
+	int run_bench = 0;
+	int calibrate = 0;
+	int allow_warm = 0;
+	int hw_scroll = 0;
+	int rotation = 1; //goggle optics
+	int mirror_x = 0;
+	int mirror_y = 0;
+	int disc = 0;
+	int max_fps = FRAME_SCHED_DEFAULT_FPS;
+	int te_line = -1;
+	int scrollback = TEXT_SCROLLBACK_DEFAULT;
+	int rcvbuf = SOCKET_RCVBUF_DEFAULT;
+	struct spi_profile profile;
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, "bcwsr:xydf:t:k:R:h", long_opts, NULL)) != -1) {
+		switch (opt) {
+		case 'b':
+			run_bench = 1;
+			break;
+		case 'c':
+			calibrate = 1;
+			break;
+		case 'w':
+			allow_warm = 1;
+			break;
+		case 's':
+			hw_scroll = 1;
+			break;
+		case 'r':
+			rotation = atoi(optarg);
+			break;
+		case 'x':
+			mirror_x = 1;
+			break;
+		case 'y':
+			mirror_y = 1;
+			break;
+		case 'd':
+			disc = 1;
+			break;
+		case 'f':
+			max_fps = atoi(optarg);
+			break;
+		case 't':
+			te_line = atoi(optarg);
+			break;
+		case 'k':
+			scrollback = atoi(optarg);
+			break;
+		case 'R':
+			rcvbuf = atoi(optarg);
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
 		}
 	}
-}
-
-int setup_2gpio(char *chipname, int line_1, int line_2) {
-	int ret = -1;
-	struct gpiod_chip *c = NULL;
-	struct gpiod_line *l1 = NULL;
-	struct gpiod_line *l2 = NULL;
 
-	c = gpiod_chip_open(chipname);
-	if (!c) {
-		perror("open gpiochip");
-		goto done;
+	if (max_fps <= 0) {
+		fprintf(stderr, "fps must be positive\n");
+		return 1;
 	}
-
-	l1 = gpiod_chip_get_line(c, line_1);
-	if (!l1) {
-		perror("get line1");
-		goto done;
+	if (scrollback < 0 || scrollback > TEXT_SCROLLBACK_MAX) {
+		fprintf(stderr, "scrollback must be 0-%d rows\n", TEXT_SCROLLBACK_MAX);
+		return 1;
 	}
 
-	if (gpiod_line_request_output(l1, "gc9a01_dc", 0) < 0) {
-		perror("request line1 output");
-		goto done;
+    setup(allow_warm);
+	if (GC9A01_set_orientation(rotation, mirror_x, mirror_y) != 0) {
+		fprintf(stderr, "rotation must be 0-3\n");
+		close_gpio();
+		spi_close();
+		return 1;
 	}
-
-	l2 = gpiod_chip_get_line(c, line_2);
-	if (!l2) {
-		perror("get line2");
-		goto done;
+	//packed buffers for every flush, allocated once
+	if (buffer_pool_init() != 0) {
+		pabort("buffer pool init failed");
 	}
-
-	if (gpiod_line_request_output(l2, "gc9a01_res", 0) < 0) {
-		perror("request line2 output");
-		goto done;
+	//non-ASCII glyphs, paged in as they are drawn
+	if (font_atlas_open(FONT_ATLAS_PATH) != 0) {
+		printf("No font atlas at %s, ASCII only\n", FONT_ATLAS_PATH);
 	}
-
-	/* publish handles only after everything succeeds */
-	chip = c;
-	line1 = l1;
-	line2 = l2;
-	ret = 0;
-
-done:
-	if (ret != 0) {
-		if (l1) gpiod_line_release(l1);
-		if (l2) gpiod_line_release(l2);
-		if (c) gpiod_chip_close(c);
+	if (textbuffer_set_scrollback(scrollback) != 0) {
+		pabort("scrollback allocation failed");
 	}
-	return ret;
-}
-//cleanup function
-void close_gpio(void) {
-    if (line1) {
-        gpiod_line_release(line1);
-        line1 = NULL;
-    }
-    if (line2) {
-        gpiod_line_release(line2);
-        line2 = NULL;
-    }
-    if (chip) {
-        gpiod_chip_close(chip);
-        chip = NULL;
-    }
-}
-
-//use usleep(POSIX) for microseconds of sleep
 
-void setup() {
-	//sets up GPIO, SPI, and initializes GC9A01
-    int gpio;
-	int spi;
-
-	/* Configure pinmux before touching GPIO/SPI */
-	if (run_pinmux() != 0) {
-		pabort("pinmux setup failed");
-	}
-	
-	gpio = setup_2gpio(chipname, DC, RES);
-	if (gpio != 0) {
-		pabort("failed to set up GPIO");
+	//reuse calibrated SPI settings unless asked to recalibrate
+	if (calibrate) {
+		if (spi_autotune_run(NULL, NULL, &profile) == 0) {
+			spi_profile_save(SPI_PROFILE_PATH, &profile);
+		}
+		fb_shadow_invalidate(); //panel shows the calibration pattern
+	} else if (spi_profile_load(SPI_PROFILE_PATH, &profile) == 0) {
+		spi_profile_apply(&profile);
 	}
+	fb_set_disc_clip(disc);
 
-    sleep(1);
-
-	printf("Initializing SPI...\n");
-
-	spi = spi_init();
-	if (spi != 0) {
+	if (run_bench) {
+		int ret = bench_run();
+		font_atlas_close();
+		buffer_pool_destroy();
 		close_gpio();
-		pabort("couldn't initialize spi");
+		spi_close();
+		return ret == 0 ? 0 : 1;
 	}
 
-	sleep(1);
-	if (GC9A01_init() != 0) {
-		close(spi_fd);
-		spi_fd = -1;
+	//the panel scrolls gate lines: refuse rather than quietly scroll in software
+	if (hw_scroll && textbuffer_set_hw_scroll(1) != 0) {
+		fprintf(stderr, "--hw-scroll needs text rows along the panel's gate lines: use --rotate 0\n");
+		font_atlas_close();
+		buffer_pool_destroy();
 		close_gpio();
-		pabort("GC9A01 init failed");
+		spi_close();
+		return 1;
 	}
 
-	struct GC9A01_frame frame = {{0,0},{239,239}};
-	GC9A01_set_frame(frame);
-}
-
-//program entrypoint
-
-int main() {
-
-    setup();
-
 	printf("IO Initialized, Loading Screen\n");
 
 	uint8_t color[2];
 	const struct GC9A01_frame full_frame = {{0,0},{239,239}}; //full screen frame (inclusive)
-	const struct GC9A01_frame text_frame = {{45, 30},{195, 210}}; //for displaying text 
-	const struct GC9A01_frame SoC_frame = {{110, 195}, {130, 215}}; //for displaying batt soc
+	const struct GC9A01_frame SoC_frame = {{214, 110}, {234, 130}}; //battery gauge, right of the 22-char text column
+	const struct GC9A01_frame console_frame = {{30, 45}, {210, 195}}; //text rows
+	const struct GC9A01_frame clock_frame = {{100, 26}, {139, 41}}; //HH:MM above the text
 	//framebuffer allocation
-	size_t fb_size = 240 * 240 * 3; //240x240 pixels, 2 bytes per pixel
+	size_t fb_size = FB_SIZE; //240x240 pixels, RGB888 or native RGB565
 	uint8_t *framebuffer = (uint8_t *)malloc(fb_size);
 	if (framebuffer == NULL) {
 		pabort("failed to allocate framebuffer");
 	}
 	fb_clear(framebuffer);
 
-	//draw startup screen
-	draw_startup_screen(framebuffer);
-	GC9A01_set_frame(full_frame);
-	fb_write_to_gc9a01_fast(framebuffer, full_frame);
-	printf("Displayed startup screen\n");
+	//show the prebuilt splash; render it only if the asset is missing
+	if (splash_show(SPLASH_PATH) == 0) {
+		printf("Displayed startup screen from %s\n", SPLASH_PATH);
+		//bring the framebuffer in line with the panel, after first pixel is out
+		draw_startup_screen(framebuffer);
+	} else {
+		draw_startup_screen(framebuffer);
+		fb_write_to_gc9a01_fast(framebuffer, full_frame);
+		printf("Displayed startup screen\n");
+	}
 	sleep(5);
 
 	//framebuffer test pattern drawing
@@ -318,9 +263,8 @@ int main() {
 	fb_draw_string(framebuffer, "top!", 30, 45, 0, 255, 0); //green text
 
 
-	//send framebuffer to LCD
-	GC9A01_set_frame(full_frame);
-	fb_write_to_gc9a01_fast(framebuffer, full_frame);
+	//send framebuffer to LCD: the initial fb_clear left the whole screen damaged
+	fb_flush_damage(framebuffer);
 	printf("Displayed fast framebuffer test pattern\n");
 
 	sleep(2);
@@ -328,9 +272,9 @@ int main() {
 	//simulate receiving data over socket, no newline characters
 	char test_string[] = "This is a test of";
 	fb_receive_and_update_text(framebuffer, test_string);
+	fb_clear(framebuffer); //drop the test pattern, text only from here on
 	textbuffer_render(framebuffer);
-	GC9A01_set_frame(full_frame);
-	fb_write_to_gc9a01_fast(framebuffer, full_frame);
+	fb_flush_damage(framebuffer);
 	printf("Displayed received text over socket\n");
 
 	sleep(2);
@@ -340,8 +284,7 @@ int main() {
 
 	fb_receive_and_update_text(framebuffer, test_string2);
 	textbuffer_render(framebuffer);
-	GC9A01_set_frame(text_frame);
-	fb_write_to_gc9a01_fast(framebuffer, text_frame);
+	fb_flush_damage(framebuffer);
 	printf("Displayed received text over socket\n");
 
 	sleep(5);
@@ -352,47 +295,122 @@ int main() {
 	}
 	printf("stop in %d\n", stop_counter);
 
-	int server_fd = setup_socket();
+	int server_fd = setup_socket(rcvbuf);
 	if (server_fd == -1) {
 		pabort("socket setup failed");
 	}
-	char buffer[1024]; //buffer for receiving strings UTF-8 encoded
+	struct flush_stats flush_stats;
+	struct frame_sched_stats sched_stats;
+	struct fb_damage damage;
+
+	//each widget refreshes on its own schedule and goes out through its own window
+	struct proto_target target = { .framebuffer = framebuffer };
+	target.console = widget_add_console(console_frame);
+	//hardware scroll moves whole panel lines, and the gauge sits beside the text on them
+	if (!hw_scroll) {
+		target.battery = widget_add_battery(SoC_frame, BATTERY_CAPACITY_PATH);
+	} else {
+		printf("Battery gauge off: it would scroll with the text\n");
+	}
+	widget_add_clock(clock_frame);
+	//widgets and blits get their own layers, so neither redraws the other; hardware scroll
+	//moves the panel lines under every layer, so it keeps drawing straight into the framebuffer
+	if (!hw_scroll) {
+		target.background = widget_layers_create();
+	}
+
+	//before any thread starts, so SIGINT/SIGTERM only ever reach the signalfd
+	if (event_loop_init(server_fd) != 0) {
+		pabort("event loop setup failed");
+	}
+
+	frame_sched_init(max_fps);
+
+	//from here on the flush thread owns the SPI device, and waits for TE right before each transfer
+	if (flush_thread_start(te_line) != 0) {
+		pabort("flush thread start failed");
+	}
 
 
 	while (stop_flag == 0) {
-		//main loop: read socket, update text framebuffer, render, write to LCD
-		int bytes_received = receive_data(server_fd, (uint8_t *)buffer, sizeof(buffer) - 1);
-		if (bytes_received > 0) {
-			buffer[bytes_received] = '\0'; //null-terminate
+		//main loop: take in every datagram, render and flush once the scheduler says a frame is due
+		//sleeps until input, a signal, or the next frame/widget deadline (none: no timeout)
+		unsigned events = event_loop_wait(frame_sched_timeout_ms(widget_timeout_ms(-1)));
+		if (events & EVENT_STOP) {
+			stop_flag = 1;
+			break;
+		}
+		if (events & EVENT_INPUT) {
+			//everything queued is applied before the one render that follows
+			int received = receive_batch(server_fd, on_datagram, &target);
+			if (received > 0) {
+				frame_sched_mark(); //blits draw outside any widget
+			}
+			else if (received == -1) {
+				printf("Error receiving data\n");
+			}
 		}
-		else if (bytes_received == -1) {
-			printf("Error receiving data\n");
+		if (widget_pending()) {
+			frame_sched_mark();
+		}
+		if (!frame_sched_begin()) {
 			continue;
 		}
-		else {
-			//no data received, continue
+		widget_refresh(framebuffer, &damage);
+		if (damage.count == 0 && !damage.scroll_pending) {
+			frame_sched_cancel(); //periodic widgets that had nothing new to show
 			continue;
 		}
-			printf("Received %d bytes: %s\n", bytes_received, buffer);
-			fb_receive_and_update_text(framebuffer, buffer);
-			textbuffer_render(framebuffer);
-			GC9A01_set_frame(text_frame);
-			fb_write_to_gc9a01_fast(framebuffer, text_frame);
+		flush_submit_damage(framebuffer, &damage);
+		flush_get_stats(&flush_stats);
+		frame_sched_get_stats(&sched_stats);
+		printf("Last flush: %llu bytes in %llu syscalls, %llu us (%llu frames replaced, %llu updates in %llu frames)\n",
+		       (unsigned long long)flush_stats.last.bytes,
+		       (unsigned long long)flush_stats.last.syscalls,
+		       (unsigned long long)(flush_stats.last.transfer_ns / 1000),
+		       (unsigned long long)flush_stats.replaced,
+		       (unsigned long long)sched_stats.updates,
+		       (unsigned long long)sched_stats.frames);
 	}
 
 
 	//cleanup
+	struct event_loop_stats loop_stats;
+	event_loop_get_stats(&loop_stats);
+	printf("Event loop: %llu wakeups, %llu with input, %llu timer\n",
+	       (unsigned long long)loop_stats.wakeups, (unsigned long long)loop_stats.input,
+	       (unsigned long long)loop_stats.timer);
+	struct socket_rx_stats rx_stats;
+	socket_rx_get_stats(&rx_stats);
+	printf("Socket: %llu datagrams in %llu recvmmsg calls, %llu coalesced, %llu dropped\n",
+	       (unsigned long long)rx_stats.received, (unsigned long long)rx_stats.syscalls,
+	       (unsigned long long)rx_stats.coalesced, (unsigned long long)rx_stats.dropped);
+	struct proto_stats proto_stats;
+	proto_get_stats(&proto_stats);
+	printf("Protocol: %llu text datagrams, %llu commands, %llu malformed\n",
+	       (unsigned long long)proto_stats.text, (unsigned long long)proto_stats.messages,
+	       (unsigned long long)proto_stats.malformed);
+	flush_thread_stop();
+	flush_get_stats(&flush_stats);
+	printf("Flush: %llu frames sent of %llu submitted; not sent: %llu bytes unchanged, %llu bytes outside the disc\n",
+	       (unsigned long long)flush_stats.flushed, (unsigned long long)flush_stats.submitted,
+	       (unsigned long long)flush_stats.unchanged_bytes, (unsigned long long)flush_stats.disc_skipped_bytes);
+	if (te_line >= 0) {
+		printf("TE: %llu frames started on an edge, %llu waits timed out\n",
+		       (unsigned long long)flush_stats.te_edges, (unsigned long long)flush_stats.te_timeouts);
+	}
+	event_loop_close();
 	close_socket(server_fd);
 	printf("Socket closed\n");
 
+	comp_destroy();
 	free(framebuffer);
+	font_atlas_close();
+	buffer_pool_destroy();
 	close_gpio();
 	printf("GPIO closed\n");
-	if (spi_fd >= 0) {
-		close(spi_fd);
-		spi_fd = -1;
-		printf("SPI closed\n");
-	}
+	spi_close();
+	printf("SPI closed\n");
     return 0;
 
 }
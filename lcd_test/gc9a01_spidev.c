@@ -0,0 +1,465 @@
+/*
+* GC9A01 HAL backend for the Jetson Orin Nano:
+* SPI0 through spidev, D/C and RESET through libgpiod
+* Copyright (c) 2025 Eric Liu
+* MIT License
+*/
+#include "GC9A01.h"
+
+#include <stdint.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <linux/types.h>
+#include <linux/spi/spidev.h>
+
+#include <gpiod.h>
+
+//define LINE NUMBERS <-> 40 pin hdr pins used by GPIO
+#define RES 106
+#define DC 105
+
+//spidev message limits
+#define SPI_MAX_XFERS 64    // transfers per SPI_IOC_MESSAGE(N)
+#define SPIDEV_BUFSIZ_PATH "/sys/module/spidev/parameters/bufsiz"
+
+//pinmux registers for the SPI0/GPIO pads, same writes as pinmux_setup.sh
+#define PINMUX_BASE 0x2430000
+#define PINMUX_REG_A 0x068
+#define PINMUX_REG_B 0x070
+#define PINMUX_VALUE 0x8
+
+
+static const char *device = "/dev/spidev0.0";
+static uint8_t mode = 0;
+static uint8_t bits = 8;
+static uint32_t speed = 5000000;
+static uint16_t delay = 0;
+const char *chipname = "/dev/gpiochip0";
+static const char *pinmux_script = "sh ./pinmux_setup.sh";
+static size_t spi_bufsiz = 4096; //spidev caps the total bytes of one message at bufsiz
+static size_t spi_xfer_size = 4096; //conservative max single transfer size for Jetson kernel
+
+static struct gpiod_chip *chip;
+static struct gpiod_line *line1;
+static struct gpiod_line *line2;
+static struct gpiod_line *te_line;
+
+int spi_fd = -1;
+
+static struct GC9A01_hal_stats hal_stats;
+static int dc_level = -1;
+
+
+static void pabort(const char *s){
+    perror(s);
+    abort();
+}
+
+static uint64_t monotonic_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+//read spidev's bufsiz module parameter; raise it with spidev.bufsiz=131072 on the kernel command line
+static size_t read_spidev_bufsiz(void) {
+	unsigned long val = 0;
+	FILE *f = fopen(SPIDEV_BUFSIZ_PATH, "r");
+	if (!f) {
+		return 4096;
+	}
+	if (fscanf(f, "%lu", &val) != 1 || val == 0) {
+		val = 4096;
+	}
+	fclose(f);
+	return (size_t)val;
+}
+
+//write the pinmux registers directly through /dev/mem (needs root)
+static int pinmux_devmem(void) {
+	long page = sysconf(_SC_PAGESIZE);
+	int fd = open("/dev/mem", O_RDWR | O_SYNC);
+	if (fd < 0) {
+		return -1;
+	}
+	volatile uint32_t *regs = mmap(NULL, (size_t)page, PROT_READ | PROT_WRITE, MAP_SHARED, fd, PINMUX_BASE);
+	close(fd);
+	if (regs == MAP_FAILED) {
+		return -1;
+	}
+	regs[PINMUX_REG_A / 4] = PINMUX_VALUE;
+	regs[PINMUX_REG_B / 4] = PINMUX_VALUE;
+	munmap((void *)regs, (size_t)page);
+	return 0;
+}
+
+static int run_pinmux(void) {
+	if (pinmux_devmem() == 0) {
+		return 0;
+	}
+
+	//not root: fall back to the sudo script
+	int ret = system(pinmux_script);
+	if (ret == -1) {
+		perror("system(pinmux)");
+		return -1;
+	}
+
+	if (WIFEXITED(ret) && WEXITSTATUS(ret) == 0) {
+		return 0;
+	}
+
+	fprintf(stderr, "pinmux script exited with status %d\n", WEXITSTATUS(ret));
+	return -1;
+}
+
+
+int spi_init(){
+    int ret = 0;
+
+    spi_fd = open(device, O_RDWR);
+    if (spi_fd < 0) {
+        perror("can't open device");
+        return -1;
+    }
+
+    //setting SPI mode
+    ret = ioctl(spi_fd, SPI_IOC_WR_MODE, &mode);
+    if (ret == -1)
+        goto fail;
+
+    ret = ioctl(spi_fd, SPI_IOC_RD_MODE, &mode);
+    if (ret == -1)
+        goto fail;
+    /*
+	 * bits per word
+	 */
+	ret = ioctl(spi_fd, SPI_IOC_WR_BITS_PER_WORD, &bits);
+	if (ret == -1)
+		goto fail;
+
+	ret = ioctl(spi_fd, SPI_IOC_RD_BITS_PER_WORD, &bits);
+	if (ret == -1)
+		goto fail;
+
+	/*
+	 * max speed hz
+	 */
+	ret = ioctl(spi_fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed);
+	if (ret == -1)
+		goto fail;
+
+	ret = ioctl(spi_fd, SPI_IOC_RD_MAX_SPEED_HZ, &speed);
+	if (ret == -1)
+		goto fail;
+
+	spi_bufsiz = read_spidev_bufsiz();
+
+	printf("spi mode: %d\n", mode);
+	printf("bits per word: %d\n", bits);
+	printf("max speed: %d Hz (%d KHz)\n", speed, speed/1000);
+	printf("spidev bufsiz: %zu bytes\n", spi_bufsiz);
+
+	return ret;
+fail:
+	perror("spi config");
+	if (spi_fd >= 0) {
+		close(spi_fd);
+		spi_fd = -1;
+	}
+	return -1;
+
+}
+
+void spi_close(void) {
+	if (spi_fd >= 0) {
+		close(spi_fd);
+		spi_fd = -1;
+	}
+}
+
+void GC9A01_set_reset(uint8_t val){
+	if (line2) {
+		gpiod_line_set_value(line2, val);
+	}
+}
+
+void GC9A01_set_data_command(uint8_t val){
+	if (val != dc_level) {
+		hal_stats.dc_toggles++;
+		dc_level = val;
+	}
+	if (line1) {
+		gpiod_line_set_value(line1, val);
+	}
+}
+
+//scatter-gather: the payload goes out as SPI_IOC_MESSAGE(N) transfer arrays,
+//each message as large as bufsiz allows, so CS stays asserted across chunks
+void GC9A01_spi_tx(uint8_t *data, size_t len){
+	struct spi_ioc_transfer tr[SPI_MAX_XFERS];
+	size_t offset = 0;
+
+	while (offset < len) {
+		size_t msg_len = 0;
+		unsigned int n = 0;
+
+		memset(tr, 0, sizeof(tr));
+		while (offset < len && n < SPI_MAX_XFERS && msg_len < spi_bufsiz) {
+			size_t this_len = len - offset;
+			if (this_len > spi_xfer_size) this_len = spi_xfer_size;
+			if (this_len > spi_bufsiz - msg_len) this_len = spi_bufsiz - msg_len;
+
+			tr[n].tx_buf = (unsigned long)(data + offset);
+			tr[n].len = this_len;
+			tr[n].delay_usecs = delay;
+			tr[n].speed_hz = speed;
+			tr[n].bits_per_word = bits;
+			n++;
+			offset += this_len;
+			msg_len += this_len;
+		}
+
+		uint64_t t0 = monotonic_ns();
+		if (ioctl(spi_fd, SPI_IOC_MESSAGE(n), tr) < 1) {
+			pabort("can't send spi message");
+		}
+		hal_stats.transfer_ns += monotonic_ns() - t0;
+		hal_stats.syscalls++;
+		hal_stats.bytes += msg_len;
+	}
+}
+
+//full-duplex read while clocking out zeros
+void GC9A01_spi_rx(uint8_t *data, size_t len){
+	struct spi_ioc_transfer tr = {
+		.tx_buf = 0,
+		.rx_buf = (unsigned long)data,
+		.len = len,
+		.delay_usecs = delay,
+		.speed_hz = speed,
+		.bits_per_word = bits,
+	};
+
+	uint64_t t0 = monotonic_ns();
+	if (ioctl(spi_fd, SPI_IOC_MESSAGE(1), &tr) < 1) {
+		pabort("can't receive spi message");
+	}
+	hal_stats.transfer_ns += monotonic_ns() - t0;
+	hal_stats.syscalls++;
+	hal_stats.bytes += len;
+}
+
+int GC9A01_spi_set_speed(uint32_t speed_hz){
+	if (ioctl(spi_fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed_hz) == -1) {
+		perror("SPI_IOC_WR_MAX_SPEED_HZ");
+		return -1;
+	}
+	speed = speed_hz;
+	return 0;
+}
+
+uint32_t GC9A01_spi_get_speed(void){
+	return speed;
+}
+
+size_t GC9A01_spi_max_transfer(void){
+	return spi_bufsiz;
+}
+
+int GC9A01_spi_set_xfer_size(size_t bytes){
+	if (bytes == 0 || bytes > spi_bufsiz) {
+		return -1;
+	}
+	spi_xfer_size = bytes;
+	return 0;
+}
+
+size_t GC9A01_spi_get_xfer_size(void){
+	return spi_xfer_size;
+}
+
+void GC9A01_get_hal_stats(struct GC9A01_hal_stats *stats) {
+	*stats = hal_stats;
+}
+
+void GC9A01_reset_hal_stats(void) {
+	struct GC9A01_hal_stats zero = {0};
+	hal_stats = zero;
+}
+
+int setup_2gpio(char *chipname, int line_1, int line_2) {
+	int ret = -1;
+	struct gpiod_chip *c = NULL;
+	struct gpiod_line *l1 = NULL;
+	struct gpiod_line *l2 = NULL;
+
+	c = gpiod_chip_open(chipname);
+	if (!c) {
+		perror("open gpiochip");
+		goto done;
+	}
+
+	l1 = gpiod_chip_get_line(c, line_1);
+	if (!l1) {
+		perror("get line1");
+		goto done;
+	}
+
+	if (gpiod_line_request_output(l1, "gc9a01_dc", 0) < 0) {
+		perror("request line1 output");
+		goto done;
+	}
+
+	l2 = gpiod_chip_get_line(c, line_2);
+	if (!l2) {
+		perror("get line2");
+		goto done;
+	}
+
+	//request RESET released so a warm start doesn't reset the panel
+	if (gpiod_line_request_output(l2, "gc9a01_res", 1) < 0) {
+		perror("request line2 output");
+		goto done;
+	}
+
+	/* publish handles only after everything succeeds */
+	chip = c;
+	line1 = l1;
+	line2 = l2;
+	dc_level = 0;
+	ret = 0;
+
+done:
+	if (ret != 0) {
+		if (l1) gpiod_line_release(l1);
+		if (l2) gpiod_line_release(l2);
+		if (c) gpiod_chip_close(c);
+	}
+	return ret;
+}
+//TE line as rising edge events; needs the chip from setup_2gpio
+int GC9A01_te_open(int line) {
+	if (!chip) {
+		fprintf(stderr, "TE: GPIO chip not open\n");
+		return -1;
+	}
+	struct gpiod_line *l = gpiod_chip_get_line(chip, line);
+	if (!l) {
+		perror("get TE line");
+		return -1;
+	}
+	if (gpiod_line_request_rising_edge_events(l, "gc9a01_te") < 0) {
+		perror("request TE events");
+		return -1;
+	}
+	te_line = l;
+	return 0;
+}
+
+int GC9A01_te_wait(int timeout_ms) {
+	struct gpiod_line_event ev;
+	struct timespec ts = { timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000L };
+
+	if (!te_line) {
+		return -1;
+	}
+	int ret = gpiod_line_event_wait(te_line, &ts);
+	if (ret <= 0) {
+		if (ret < 0) {
+			perror("wait TE");
+		}
+		return ret;
+	}
+	//consume the edge so the next wait blocks until a fresh one
+	if (gpiod_line_event_read(te_line, &ev) < 0) {
+		perror("read TE");
+		return -1;
+	}
+	return 1;
+}
+
+void GC9A01_te_close(void) {
+	if (te_line) {
+		gpiod_line_release(te_line);
+		te_line = NULL;
+	}
+}
+
+//cleanup function
+void close_gpio(void) {
+    GC9A01_te_close();
+    if (line1) {
+        gpiod_line_release(line1);
+        line1 = NULL;
+    }
+    if (line2) {
+        gpiod_line_release(line2);
+        line2 = NULL;
+    }
+    if (chip) {
+        gpiod_chip_close(chip);
+        chip = NULL;
+    }
+}
+
+static double ms_since(uint64_t *t) {
+	uint64_t now = monotonic_ns();
+	double ms = (double)(now - *t) / 1e6;
+	*t = now;
+	return ms;
+}
+
+void setup(int allow_warm) {
+	//sets up GPIO, SPI, and initializes GC9A01
+    int gpio;
+	int spi;
+	int warm = 0;
+	uint64_t t = monotonic_ns();
+	uint64_t t_start = t;
+	double pinmux_ms, gpio_ms, spi_ms, init_ms;
+
+	/* Configure pinmux before touching GPIO/SPI */
+	if (run_pinmux() != 0) {
+		pabort("pinmux setup failed");
+	}
+	pinmux_ms = ms_since(&t);
+
+	gpio = setup_2gpio((char *)chipname, DC, RES);
+	if (gpio != 0) {
+		pabort("failed to set up GPIO");
+	}
+	gpio_ms = ms_since(&t);
+
+	printf("Initializing SPI...\n");
+
+	spi = spi_init();
+	if (spi != 0) {
+		close_gpio();
+		pabort("couldn't initialize spi");
+	}
+	spi_ms = ms_since(&t);
+
+	if (allow_warm && GC9A01_init_warm() == 0) {
+		warm = 1;
+	} else if (GC9A01_init() != 0) {
+		spi_close();
+		close_gpio();
+		pabort("GC9A01 init failed");
+	}
+	init_ms = ms_since(&t);
+
+	struct GC9A01_frame frame = {{0,0},{239,239}};
+	GC9A01_set_frame(frame);
+
+	printf("startup: pinmux %.1f ms, gpio %.1f ms, spi %.1f ms, %s init %.1f ms (%llu ioctls), total %.1f ms\n",
+	       pinmux_ms, gpio_ms, spi_ms, warm ? "warm" : "cold", init_ms,
+	       (unsigned long long)hal_stats.syscalls, (double)(monotonic_ns() - t_start) / 1e6);
+}
@@ -0,0 +1,495 @@
+/*
+* Virtual GC9A01 HAL backend
+* Decodes the SPI command stream into an in-memory 240x240 panel
+* so rendering and flush paths can be measured off-hardware.
+* MIT License
+*/
+#include "GC9A01.h"
+#include "gc9a01_virtual.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MADCTL_MY 0x80
+#define MADCTL_MX 0x40
+#define MADCTL_MV 0x20
+
+#define COLMOD_12_BIT 0x03
+#define COLMOD_16_BIT 0x05
+#define COLMOD_18_BIT 0x06
+
+static uint16_t panel_mem[VPANEL_WIDTH * VPANEL_HEIGHT];
+
+static struct {
+    uint8_t dc;
+    uint8_t cmd;
+    uint8_t params[8];
+    size_t nparams;
+    int in_mem_write;
+    uint16_t xs, xe, ys, ye;    // address window (inclusive)
+    uint16_t cur_c, cur_r;      // write cursor inside the window
+    uint8_t pend[3];            // partial pixel bytes
+    size_t npend;
+    uint8_t madctl;
+    uint8_t colmod;
+    uint8_t power_mode;         // RDDPM bits: 0x10 sleep out, 0x04 display on
+    uint16_t tfa, vsa, bfa;     // vertical scroll definition, in gate lines
+    uint16_t vsp;               // memory line shown at the top of the scroll area
+} vp;
+
+static uint32_t clock_hz = 5000000;
+static size_t max_transfer = 4096;          // spidev default bufsiz
+static size_t xfer_size = 4096;             // transfer size inside a message (not modelled)
+static uint32_t syscall_overhead_ns = 20000; // rough per-ioctl cost, tunable
+static int realtime = 0;                     // sleep for the modelled transfer time
+static uint32_t max_reliable_hz = 80000000;  // reads come back corrupted above this clock
+
+#define VPANEL_ID 0x009A01 // model value returned by RDDID
+
+static struct GC9A01_hal_stats hal_stats;
+static struct vpanel_stats panel_stats;
+
+static void vpanel_reset_state(void) {
+    vp.cmd = 0x00;
+    vp.nparams = 0;
+    vp.in_mem_write = 0;
+    vp.xs = 0;
+    vp.xe = VPANEL_WIDTH - 1;
+    vp.ys = 0;
+    vp.ye = VPANEL_HEIGHT - 1;
+    vp.cur_c = 0;
+    vp.cur_r = 0;
+    vp.npend = 0;
+    vp.madctl = 0x00;
+    vp.colmod = COLMOD_18_BIT; // power-on default
+    vp.power_mode = 0x00;
+    vp.tfa = 0;
+    vp.vsa = VPANEL_HEIGHT;
+    vp.bfa = 0;
+    vp.vsp = 0;
+}
+
+//memory line the panel shows on gate line row, after vertical scrolling
+static size_t vpanel_display_row(size_t row) {
+    if (vp.vsa == 0 || row < vp.tfa || row >= (size_t)vp.tfa + vp.vsa) {
+        return row; //fixed areas
+    }
+    size_t vsp = (vp.vsp >= vp.tfa && vp.vsp < vp.tfa + vp.vsa) ? vp.vsp : vp.tfa;
+    return vp.tfa + (row - vp.tfa + vsp - vp.tfa) % vp.vsa;
+}
+
+static uint16_t vpanel_shown(size_t i) {
+    size_t row = vpanel_display_row(i / VPANEL_WIDTH);
+    return panel_mem[row * VPANEL_WIDTH + i % VPANEL_WIDTH];
+}
+
+//map a (column, page) address to physical panel memory: mirror first, then exchange
+static void vpanel_plot(uint16_t color) {
+    uint16_t c = vp.cur_c;
+    uint16_t r = vp.cur_r;
+
+    if (c < VPANEL_WIDTH && r < VPANEL_HEIGHT) {
+        if (vp.madctl & MADCTL_MX) c = VPANEL_WIDTH - 1 - c;
+        if (vp.madctl & MADCTL_MY) r = VPANEL_HEIGHT - 1 - r;
+        size_t index = (vp.madctl & MADCTL_MV) ? (size_t)c * VPANEL_WIDTH + r
+                                               : (size_t)r * VPANEL_WIDTH + c;
+        panel_mem[index] = color;
+        panel_stats.pixels++;
+    }
+
+    //advance cursor, wrapping inside the window like the controller does
+    if (++vp.cur_c > vp.xe) {
+        vp.cur_c = vp.xs;
+        if (++vp.cur_r > vp.ye) {
+            vp.cur_r = vp.ys;
+        }
+    }
+}
+
+static uint16_t expand444(uint8_t r4, uint8_t g4, uint8_t b4) {
+    uint16_t r5 = (uint16_t)((r4 << 1) | (r4 >> 3));
+    uint16_t g6 = (uint16_t)((g4 << 2) | (g4 >> 2));
+    uint16_t b5 = (uint16_t)((b4 << 1) | (b4 >> 3));
+    return (uint16_t)((r5 << 11) | (g6 << 5) | b5);
+}
+
+static void vpanel_pixel_byte(uint8_t b) {
+    vp.pend[vp.npend++] = b;
+
+    switch (vp.colmod) {
+    case COLMOD_16_BIT:
+        if (vp.npend == 2) {
+            vpanel_plot((uint16_t)((vp.pend[0] << 8) | vp.pend[1]));
+            vp.npend = 0;
+        }
+        break;
+    case COLMOD_12_BIT:
+        //two pixels in three bytes: RRRRGGGG BBBBRRRR GGGGBBBB
+        if (vp.npend == 3) {
+            vpanel_plot(expand444(vp.pend[0] >> 4, vp.pend[0] & 0x0F, vp.pend[1] >> 4));
+            vpanel_plot(expand444(vp.pend[1] & 0x0F, vp.pend[2] >> 4, vp.pend[2] & 0x0F));
+            vp.npend = 0;
+        }
+        break;
+    default:
+        //18 bit: one byte per channel, 6 MSBs used
+        if (vp.npend == 3) {
+            vpanel_plot((uint16_t)(((vp.pend[0] >> 3) << 11) | ((vp.pend[1] >> 2) << 5) | (vp.pend[2] >> 3)));
+            vp.npend = 0;
+        }
+        break;
+    }
+}
+
+static void vpanel_command(uint8_t cmd) {
+    panel_stats.commands++;
+    vp.cmd = cmd;
+    vp.nparams = 0;
+    vp.npend = 0;
+    vp.in_mem_write = 0;
+
+    switch (cmd) {
+    case 0x01: // software reset
+        vpanel_reset_state();
+        break;
+    case 0x2C: // MEM_WR restarts at the window origin
+        vp.cur_c = vp.xs;
+        vp.cur_r = vp.ys;
+        vp.in_mem_write = 1;
+        break;
+    case 0x3C: // MEM_WR_CONT resumes at the cursor
+        vp.in_mem_write = 1;
+        break;
+    case 0x10: vp.power_mode &= (uint8_t)~0x10; break; // sleep in
+    case 0x11: vp.power_mode |= 0x10; break;            // sleep out
+    case 0x28: vp.power_mode &= (uint8_t)~0x04; break; // display off
+    case 0x29: vp.power_mode |= 0x04; break;            // display on
+    default:
+        break;
+    }
+}
+
+static void vpanel_data(uint8_t b) {
+    if (vp.in_mem_write) {
+        vpanel_pixel_byte(b);
+        return;
+    }
+    if (vp.nparams < sizeof(vp.params)) {
+        vp.params[vp.nparams++] = b;
+    }
+
+    switch (vp.cmd) {
+    case 0x2A: // CASET
+        if (vp.nparams == 4) {
+            vp.xs = (uint16_t)((vp.params[0] << 8) | vp.params[1]);
+            vp.xe = (uint16_t)((vp.params[2] << 8) | vp.params[3]);
+        }
+        break;
+    case 0x2B: // RASET
+        if (vp.nparams == 4) {
+            vp.ys = (uint16_t)((vp.params[0] << 8) | vp.params[1]);
+            vp.ye = (uint16_t)((vp.params[2] << 8) | vp.params[3]);
+            panel_stats.windows++;
+        }
+        break;
+    case 0x36: // MADCTL
+        if (vp.nparams == 1) vp.madctl = b;
+        break;
+    case 0x3A: // COLMOD
+        if (vp.nparams == 1) vp.colmod = b & 0x07;
+        break;
+    case 0x33: // VSCRDEF: TFA, VSA, BFA
+        if (vp.nparams == 6) {
+            uint16_t tfa = (uint16_t)((vp.params[0] << 8) | vp.params[1]);
+            uint16_t vsa = (uint16_t)((vp.params[2] << 8) | vp.params[3]);
+            uint16_t bfa = (uint16_t)((vp.params[4] << 8) | vp.params[5]);
+            if (tfa + vsa + bfa != VPANEL_HEIGHT) {
+                fprintf(stderr, "virtual panel: VSCRDEF %u+%u+%u != %d lines, ignored\n",
+                        tfa, vsa, bfa, VPANEL_HEIGHT);
+                break;
+            }
+            vp.tfa = tfa;
+            vp.vsa = vsa;
+            vp.bfa = bfa;
+        }
+        break;
+    case 0x37: // VSCSAD
+        if (vp.nparams == 2) vp.vsp = (uint16_t)((vp.params[0] << 8) | vp.params[1]);
+        break;
+    default:
+        break;
+    }
+}
+
+/* HAL implementation */
+
+void GC9A01_set_reset(uint8_t val) {
+    if (val == 0) {
+        vpanel_reset_state();
+    }
+}
+
+void GC9A01_set_data_command(uint8_t val) {
+    if (val != vp.dc) {
+        hal_stats.dc_toggles++;
+        vp.dc = val;
+    }
+}
+
+void GC9A01_spi_tx(uint8_t *data, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    //mirror the spidev backend: one SPI_IOC_MESSAGE ioctl per bufsiz worth of payload
+    uint64_t ioctls = (len + max_transfer - 1) / max_transfer;
+    uint64_t ns = ioctls * syscall_overhead_ns + (uint64_t)len * 8ull * 1000000000ull / clock_hz;
+    hal_stats.syscalls += ioctls;
+    hal_stats.bytes += len;
+    hal_stats.transfer_ns += ns;
+    if (realtime) {
+        struct timespec ts = { .tv_sec = (time_t)(ns / 1000000000ull), .tv_nsec = (long)(ns % 1000000000ull) };
+        nanosleep(&ts, NULL);
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        if (vp.dc) {
+            vpanel_data(data[i]);
+        } else {
+            vpanel_command(data[i]);
+        }
+    }
+}
+
+//RDDID answers with one dummy bit then the 24 bit ID, 8 bit status reads
+//have no dummy cycle; anything else reads as zeros
+void GC9A01_spi_rx(uint8_t *data, size_t len) {
+    uint64_t ns = syscall_overhead_ns + (uint64_t)len * 8ull * 1000000000ull / clock_hz;
+    hal_stats.syscalls++;
+    hal_stats.bytes += len;
+    hal_stats.transfer_ns += ns;
+
+    uint32_t stream = 0;
+    switch (vp.cmd) {
+    case 0x04: stream = (uint32_t)VPANEL_ID << 7; break;
+    case 0x0A: stream = (uint32_t)vp.power_mode << 24; break;
+    case 0x0B: stream = (uint32_t)vp.madctl << 24; break;
+    case 0x0C: stream = (uint32_t)vp.colmod << 24; break;
+    default: break;
+    }
+    for (size_t i = 0; i < len; i++) {
+        data[i] = (i < 4) ? (uint8_t)(stream >> (24 - 8 * i)) : 0;
+        if (clock_hz > max_reliable_hz) {
+            data[i] ^= (uint8_t)(0x5A + i); //signal integrity lost
+        }
+    }
+}
+
+int GC9A01_spi_set_speed(uint32_t speed_hz) {
+    vpanel_set_clock_hz(speed_hz);
+    return 0;
+}
+
+uint32_t GC9A01_spi_get_speed(void) {
+    return clock_hz;
+}
+
+size_t GC9A01_spi_max_transfer(void) {
+    return max_transfer;
+}
+
+int GC9A01_spi_set_xfer_size(size_t bytes) {
+    if (bytes == 0 || bytes > max_transfer) {
+        return -1;
+    }
+    xfer_size = bytes;
+    return 0;
+}
+
+size_t GC9A01_spi_get_xfer_size(void) {
+    return xfer_size;
+}
+
+void GC9A01_get_hal_stats(struct GC9A01_hal_stats *stats) {
+    *stats = hal_stats;
+}
+
+void GC9A01_reset_hal_stats(void) {
+    struct GC9A01_hal_stats zero = {0};
+    hal_stats = zero;
+}
+
+int spi_init(void) {
+    //model overrides, e.g. GC9A01_VPANEL_BUFSIZ=131072 for a raised spidev bufsiz
+    const char *env = getenv("GC9A01_VPANEL_HZ");
+    if (env) vpanel_set_clock_hz((uint32_t)strtoul(env, NULL, 0));
+    env = getenv("GC9A01_VPANEL_BUFSIZ");
+    if (env) vpanel_set_max_transfer((size_t)strtoul(env, NULL, 0));
+    env = getenv("GC9A01_VPANEL_MAX_HZ");
+    if (env) vpanel_set_max_reliable_hz((uint32_t)strtoul(env, NULL, 0));
+    env = getenv("GC9A01_VPANEL_REALTIME");
+    if (env) vpanel_set_realtime(atoi(env));
+
+    printf("virtual panel: %u Hz, %zu byte transfers\n", clock_hz, max_transfer);
+    return 0;
+}
+
+void spi_close(void) {
+    const char *ppm = getenv("GC9A01_VPANEL_PPM");
+    if (ppm && *ppm) {
+        if (vpanel_dump_ppm(ppm) == 0) {
+            printf("virtual panel image written to %s\n", ppm);
+        }
+    }
+}
+
+int setup_2gpio(char *chipname, int line_1, int line_2) {
+    (void)chipname;
+    (void)line_1;
+    (void)line_2;
+    return 0;
+}
+
+void close_gpio(void) {
+}
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+//fake TE: an edge every VPANEL_TE_PERIOD_NS on the monotonic clock, whatever the line
+static int te_open = 0;
+
+int GC9A01_te_open(int line) {
+    (void)line;
+    te_open = 1;
+    return 0;
+}
+
+int GC9A01_te_wait(int timeout_ms) {
+    if (!te_open) {
+        return -1;
+    }
+    uint64_t now = monotonic_ns();
+    uint64_t edge = (now / VPANEL_TE_PERIOD_NS + 1) * VPANEL_TE_PERIOD_NS;
+    if (edge - now > (uint64_t)timeout_ms * 1000000ull) {
+        struct timespec d = { timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000L };
+        nanosleep(&d, NULL);
+        return 0;
+    }
+    struct timespec ts = { (time_t)(edge / 1000000000ull), (long)(edge % 1000000000ull) };
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    return 1;
+}
+
+void GC9A01_te_close(void) {
+    te_open = 0;
+}
+
+void setup(int allow_warm) {
+    int warm = 0;
+
+    memset(panel_mem, 0, sizeof(panel_mem));
+    vpanel_reset_state();
+    spi_init();
+
+    //GC9A01_VPANEL_WARM=1 models a panel left configured by a previous run
+    const char *env = getenv("GC9A01_VPANEL_WARM");
+    if (env && atoi(env)) {
+        GC9A01_init();
+    }
+
+    GC9A01_reset_hal_stats();
+    uint64_t t0 = monotonic_ns();
+    if (allow_warm && GC9A01_init_warm() == 0) {
+        warm = 1;
+    } else if (GC9A01_init() != 0) {
+        fprintf(stderr, "GC9A01 init failed\n");
+        abort();
+    }
+
+    struct GC9A01_frame frame = {{0,0},{239,239}};
+    GC9A01_set_frame(frame);
+
+    printf("startup: %s init %.1f ms (%llu ioctls)\n", warm ? "warm" : "cold",
+           (double)(monotonic_ns() - t0) / 1e6, (unsigned long long)hal_stats.syscalls);
+}
+
+/* Model controls and inspection */
+
+void vpanel_set_clock_hz(uint32_t hz) {
+    if (hz > 0) clock_hz = hz;
+}
+
+void vpanel_set_max_transfer(size_t bytes) {
+    if (bytes > 0) max_transfer = bytes;
+}
+
+void vpanel_set_syscall_overhead_ns(uint32_t ns) {
+    syscall_overhead_ns = ns;
+}
+
+void vpanel_set_max_reliable_hz(uint32_t hz) {
+    max_reliable_hz = hz;
+}
+
+void vpanel_set_realtime(int enable) {
+    realtime = enable;
+}
+
+void vpanel_get_stats(struct vpanel_stats *stats) {
+    *stats = panel_stats;
+}
+
+const uint16_t *vpanel_pixels(void) {
+    return panel_mem;
+}
+
+uint8_t vpanel_madctl(void) {
+    return vp.madctl;
+}
+
+uint8_t vpanel_colmod(void) {
+    return vp.colmod;
+}
+
+uint16_t vpanel_scroll_start(void) {
+    return vp.vsp;
+}
+
+uint32_t vpanel_checksum(void) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < VPANEL_WIDTH * VPANEL_HEIGHT; i++) {
+        uint16_t p = vpanel_shown(i);
+        hash = (hash ^ (p >> 8)) * 16777619u;
+        hash = (hash ^ (p & 0xFF)) * 16777619u;
+    }
+    return hash;
+}
+
+int vpanel_dump_ppm(const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        perror("fopen ppm");
+        return -1;
+    }
+    fprintf(f, "P6\n%d %d\n255\n", VPANEL_WIDTH, VPANEL_HEIGHT);
+    for (size_t i = 0; i < VPANEL_WIDTH * VPANEL_HEIGHT; i++) {
+        uint16_t p = vpanel_shown(i);
+        uint8_t rgb[3] = {
+            (uint8_t)(((p >> 11) & 0x1F) << 3),
+            (uint8_t)(((p >> 5) & 0x3F) << 2),
+            (uint8_t)((p & 0x1F) << 3),
+        };
+        fwrite(rgb, 1, sizeof(rgb), f);
+    }
+    if (fclose(f) != 0) {
+        perror("fclose ppm");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,46 @@
+#ifndef GC9A01_VIRTUAL_H
+#define GC9A01_VIRTUAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Virtual GC9A01 panel: a HAL backend that decodes the command stream
+ * (CASET/RASET/MEM_WR/MEM_WR_CONT/MADCTL/COLMOD/VSCRDEF/VSCSAD) into an in-memory image
+ * and models the SPI cost of every transfer. Built with `make BACKEND=virtual`.
+ */
+
+#define VPANEL_WIDTH 240
+#define VPANEL_HEIGHT 240
+#define VPANEL_TE_PERIOD_NS 16666667ull //fake TE edges at 60 Hz
+
+struct vpanel_stats {
+    uint64_t commands;      // command bytes decoded
+    uint64_t windows;       // CASET/RASET pairs (address windows) set
+    uint64_t pixels;        // pixels written into panel memory
+};
+
+/* Model parameters: SPI clock, largest single ioctl (spidev bufsiz) and
+ * the fixed software cost of one ioctl round-trip. */
+void vpanel_set_clock_hz(uint32_t hz);
+void vpanel_set_max_transfer(size_t bytes);
+void vpanel_set_syscall_overhead_ns(uint32_t ns);
+/* Highest clock at which reads (RDDID) still come back intact, for calibration runs */
+void vpanel_set_max_reliable_hz(uint32_t hz);
+/* Block in GC9A01_spi_tx for the modelled transfer time, so overlap
+ * between rendering and flushing shows up in wall-clock figures. */
+void vpanel_set_realtime(int enable);
+
+void vpanel_get_stats(struct vpanel_stats *stats);
+
+/* Panel memory as RGB565, row-major in physical (unrotated) order. */
+const uint16_t *vpanel_pixels(void);
+uint8_t vpanel_madctl(void);
+uint8_t vpanel_colmod(void);
+uint16_t vpanel_scroll_start(void);
+
+/* FNV-1a hash of the image as shown, i.e. after vertical scrolling,
+ * for golden-image comparisons; the PPM dump shows the same image. */
+uint32_t vpanel_checksum(void);
+int vpanel_dump_ppm(const char *path);
+
+#endif //GC9A01_VIRTUAL_H
@@ -0,0 +1,121 @@
+/* pre-expanded glyph cache: atlas / font8x16 bitmaps turned into
+framebuffer pixels once per colour pair, then blitted a run at a time */
+
+#include "glyph_cache.h"
+#include "framebuffer.h"
+#include "font_atlas.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define ROW_BYTES (GLYPH_MAX_WIDTH * FB_BPP) //a glyph row is contiguous in the row-major framebuffer
+
+struct glyph_entry {
+    uint32_t cp;
+    uint32_t fg, bg;
+    uint32_t last_use;              // LRU stamp, 0 = empty way
+    int width;                      // pixels, 8 or 16
+    uint16_t mask[GLYPH_HEIGHT];    // font bitmap: bit 15 - col set for foreground
+    uint8_t pixels[GLYPH_HEIGHT * ROW_BYTES];
+};
+
+static struct glyph_entry cache[GLYPH_CACHE_SETS][GLYPH_CACHE_WAYS];
+static uint32_t use_clock = 0;
+static struct glyph_cache_stats stats;
+
+static void glyph_expand(struct glyph_entry *e) {
+    uint8_t fg_px[FB_BPP], bg_px[FB_BPP];
+
+    e->width = font_atlas_glyph(e->cp, e->mask); //may page in an atlas block
+
+    //let fb_set_pixel do the format conversion into one-pixel buffers
+    fb_set_pixel(fg_px, 0, 0, (uint8_t)(e->fg >> 16), (uint8_t)(e->fg >> 8), (uint8_t)e->fg);
+    fb_set_pixel(bg_px, 0, 0, (uint8_t)(e->bg >> 16), (uint8_t)(e->bg >> 8), (uint8_t)e->bg);
+
+    for (int row = 0; row < GLYPH_HEIGHT; row++) {
+        for (int col = 0; col < e->width; col++) {
+            int on = (e->mask[row] >> (15 - col)) & 1;
+            memcpy(&e->pixels[row * ROW_BYTES + col * FB_BPP], on ? fg_px : bg_px, FB_BPP);
+        }
+    }
+}
+
+static const struct glyph_entry *glyph_lookup(uint32_t cp, uint32_t fg, uint32_t bg) {
+    uint32_t h = cp * 0x9E3779B1u ^ fg * 0x85EBCA6Bu ^ bg * 0xC2B2AE35u;
+    struct glyph_entry *set = cache[(h >> 16) % GLYPH_CACHE_SETS];
+    struct glyph_entry *victim = &set[0];
+
+    use_clock++;
+    for (int w = 0; w < GLYPH_CACHE_WAYS; w++) {
+        struct glyph_entry *e = &set[w];
+        if (e->last_use && e->cp == cp && e->fg == fg && e->bg == bg) {
+            e->last_use = use_clock;
+            stats.hits++;
+            return e;
+        }
+        if (e->last_use < victim->last_use) {
+            victim = e;
+        }
+    }
+
+    stats.misses++;
+    if (victim->last_use) {
+        stats.evictions++;
+    }
+    victim->cp = cp;
+    victim->fg = fg;
+    victim->bg = bg;
+    victim->last_use = use_clock;
+    glyph_expand(victim);
+    return victim;
+}
+
+int glyph_draw(uint8_t *framebuffer, uint32_t cp, int x, int y, uint32_t fg, uint32_t bg) {
+    int opaque = bg != GLYPH_TRANSPARENT;
+    const struct glyph_entry *e = glyph_lookup(cp, fg, opaque ? bg : GLYPH_TRANSPARENT);
+    int width = e->width;
+    uint16_t full = (uint16_t)(0xFFFF << (GLYPH_MAX_WIDTH - width));
+
+    if (x < 0 || y < 0 || x + width > FB_WIDTH || y + GLYPH_HEIGHT > FB_HEIGHT) {
+        //clipped: pixel at a time, bounds checked
+        for (int row = 0; row < GLYPH_HEIGHT; row++) {
+            for (int col = 0; col < width; col++) {
+                int px = x + col;
+                int py = y + row;
+                if (px < 0 || py < 0 || px >= FB_WIDTH || py >= FB_HEIGHT ||
+                    (!opaque && !(e->mask[row] & (0x8000 >> col)))) {
+                    continue;
+                }
+                memcpy(&framebuffer[FB_INDEX(px, py)], &e->pixels[row * ROW_BYTES + col * FB_BPP], FB_BPP);
+            }
+        }
+        return width;
+    }
+
+    for (int row = 0; row < GLYPH_HEIGHT; row++) {
+        uint8_t *dst = &framebuffer[FB_INDEX(x, y + row)];
+        const uint8_t *src = &e->pixels[row * ROW_BYTES];
+        unsigned mask = e->mask[row];
+
+        if (opaque || mask == full) {
+            memcpy(dst, src, (size_t)width * FB_BPP);
+            continue;
+        }
+        //transparent: store only the foreground pixels, leftmost is bit 15
+        while (mask) {
+            int col = __builtin_clz(mask) - (int)(sizeof(unsigned) * 8 - 16);
+            memcpy(dst + col * FB_BPP, src + col * FB_BPP, FB_BPP);
+            mask &= ~(0x8000u >> col);
+        }
+    }
+    return width;
+}
+
+void glyph_cache_get_stats(struct glyph_cache_stats *out) {
+    *out = stats;
+}
+
+void glyph_cache_reset_stats(void) {
+    struct glyph_cache_stats zero = {0};
+    stats = zero;
+}
@@ -0,0 +1,38 @@
+#ifndef GLYPH_CACHE_H
+#define GLYPH_CACHE_H
+
+#include <stdint.h>
+
+/* Pre-expanded glyph cache: glyphs (font atlas, or the built-in ASCII
+ * font) rendered once per (code point, foreground, background, pixel
+ * format) into framebuffer-format rows, so drawing a character is one
+ * copy per glyph row instead of a bit test per pixel. This is the LRU
+ * of rendered glyphs in front of the atlas. Set-associative with LRU
+ * replacement; no HAL calls, so the build-time asset tools link it too.
+ */
+
+#define GLYPH_WIDTH 8        //one text cell; wide (CJK) glyphs take two
+#define GLYPH_MAX_WIDTH 16
+#define GLYPH_HEIGHT 16
+
+#define GLYPH_CACHE_SETS 32
+#define GLYPH_CACHE_WAYS 4
+
+#define GLYPH_RGB(r, g, b) (((uint32_t)(r) << 16) | ((uint32_t)(g) << 8) | (uint32_t)(b))
+#define GLYPH_TRANSPARENT 0xFF000000u //background: leave unset pixels alone
+
+struct glyph_cache_stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+};
+
+/* Draw code point cp with its top-left at (x, y); parts outside the
+ * framebuffer are clipped. bg is GLYPH_TRANSPARENT or a GLYPH_RGB colour.
+ * Returns the glyph width in pixels. */
+int glyph_draw(uint8_t *framebuffer, uint32_t cp, int x, int y, uint32_t fg, uint32_t bg);
+
+void glyph_cache_get_stats(struct glyph_cache_stats *stats);
+void glyph_cache_reset_stats(void);
+
+#endif //GLYPH_CACHE_H
@@ -0,0 +1,122 @@
+/* binary command protocol on the display socket, with plain text as
+the fallback for existing senders */
+
+#include "protocol.h"
+#include "framebuffer.h"
+#include "glyph_cache.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+_Static_assert(sizeof(struct proto_header) == PROTO_HEADER_SIZE, "header layout");
+
+static struct proto_stats stats;
+
+static uint16_t rd16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static int32_t rd32(const uint8_t *p) {
+    return (int32_t)((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+//one message; payload points into the datagram
+static int proto_apply(struct proto_target *t, uint8_t type, uint16_t arg, const uint8_t *payload, uint16_t len) {
+    switch (type) {
+    case PROTO_APPEND_TEXT:
+        textbuffer_write((const char *)payload, len);
+        widget_invalidate(t->console);
+        return 0;
+    case PROTO_REPLACE_ROW:
+        if (textbuffer_replace_row(arg, (const char *)payload, len) != 0) {
+            return -1;
+        }
+        widget_invalidate(t->console);
+        return 0;
+    case PROTO_CLEAR:
+        textbuffer_initialize();
+        widget_invalidate(t->console);
+        return 0;
+    case PROTO_SET_COLOR:
+        if (len != 6) {
+            return -1;
+        }
+        textbuffer_set_color(GLYPH_RGB(payload[0], payload[1], payload[2]),
+                             GLYPH_RGB(payload[3], payload[4], payload[5]));
+        widget_invalidate(t->console);
+        return 0;
+    case PROTO_BLIT: {
+        if (len < 8) {
+            return -1;
+        }
+        int x = rd16(payload), y = rd16(payload + 2), w = rd16(payload + 4), h = rd16(payload + 6);
+        if (w == 0 || h == 0 || x + w > FB_WIDTH || y + h > FB_HEIGHT || len != 8 + (size_t)w * (size_t)h * 2) {
+            return -1;
+        }
+        if (t->background) {
+            //under the widgets: text drawn over a blit stays readable
+            fb_blit_rgb565(comp_layer_pixels(t->background), x, y, w, h, payload + 8);
+            comp_layer_commit(t->background); //recomposited with the next frame
+        } else {
+            fb_blit_rgb565(t->framebuffer, x, y, w, h, payload + 8); //damage goes out with the next frame
+        }
+        return 0;
+    }
+    case PROTO_SET_WIDGET:
+        if (len != 4) {
+            return -1;
+        }
+        if (arg == PROTO_WIDGET_BATTERY && t->battery) {
+            int32_t v = rd32(payload);
+            widget_battery_set_level(t->battery, v < 0 || v > 100 ? -1 : (int)v);
+            return 0;
+        }
+        return -1;
+    default:
+        return -1;
+    }
+}
+
+int proto_handle(struct proto_target *t, char *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    const uint8_t *end = p + len;
+    int applied = 0;
+
+    if (len == 0 || p[0] != PROTO_MAGIC) {
+        //plain text: one datagram, one word or more
+        fb_receive_and_update_text(t->framebuffer, data);
+        widget_invalidate(t->console);
+        stats.text++;
+        return 1;
+    }
+
+    while (p < end) {
+        if (end - p < PROTO_HEADER_SIZE || p[0] != PROTO_MAGIC || p[1] != PROTO_VERSION) {
+            break;
+        }
+        uint8_t type = p[2];
+        uint16_t arg = rd16(p + 4);
+        uint16_t length = rd16(p + 6);
+        if (end - p - PROTO_HEADER_SIZE < length) {
+            break;
+        }
+        if (proto_apply(t, type, arg, p + PROTO_HEADER_SIZE, length) != 0) {
+            break;
+        }
+        applied++;
+        p += PROTO_HEADER_SIZE + length;
+    }
+
+    stats.messages += (uint64_t)applied;
+    if (p < end) {
+        fprintf(stderr, "protocol: bad message at byte %zu of %zu, rest dropped\n",
+                (size_t)(p - (const uint8_t *)data), len);
+        stats.malformed++;
+        return -1;
+    }
+    return applied;
+}
+
+void proto_get_stats(struct proto_stats *out) {
+    *out = stats;
+}
@@ -0,0 +1,73 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "widget.h"
+
+/* Binary command protocol on the display socket. A datagram whose first
+ * byte is PROTO_MAGIC (0xFF never occurs in UTF-8) holds one or more
+ * messages back to back, each an 8-byte header and its payload; any
+ * other datagram is plain text, appended as before. Multi-byte fields
+ * are little-endian, except blit pixels, which are big-endian RGB565 in
+ * panel order. Messages are read where they lie in the receive buffer.
+ *
+ * The socket takes datagrams of up to SOCKET_DGRAM_MAX bytes, so any
+ * single message fits. A blit payload is at most 65535 bytes: 32763
+ * pixels (e.g. 180x180); a full screen goes as two blits.
+ *
+ *   type                  arg          payload
+ *   PROTO_APPEND_TEXT     -            UTF-8 text, no implied space
+ *   PROTO_REPLACE_ROW     row (0: lowest)  UTF-8 text
+ *   PROTO_CLEAR           -            -
+ *   PROTO_SET_COLOR       -            fg r,g,b then bg r,g,b
+ *   PROTO_BLIT            -            u16 x,y,w,h then w*h RGB565 pixels
+ *   PROTO_SET_WIDGET      widget id    s32 value (battery: percent, -1 unknown)
+ */
+
+#define PROTO_MAGIC 0xFF
+#define PROTO_VERSION 1
+#define PROTO_HEADER_SIZE 8
+
+enum proto_type {
+    PROTO_APPEND_TEXT = 1,
+    PROTO_REPLACE_ROW = 2,
+    PROTO_CLEAR = 3,
+    PROTO_SET_COLOR = 4,
+    PROTO_BLIT = 5,
+    PROTO_SET_WIDGET = 6,
+};
+
+enum proto_widget {
+    PROTO_WIDGET_BATTERY = 0,
+};
+
+struct proto_header {
+    uint8_t magic;      // PROTO_MAGIC
+    uint8_t version;    // PROTO_VERSION
+    uint8_t type;       // enum proto_type
+    uint8_t flags;      // 0
+    uint16_t arg;
+    uint16_t length;    // payload bytes following the header
+};
+
+//what the commands act on
+struct proto_target {
+    uint8_t *framebuffer;
+    struct widget *console;
+    struct widget *battery;
+    struct comp_layer *background; // blits go here when set, else into framebuffer
+};
+
+struct proto_stats {
+    uint64_t text;          // plain-text datagrams
+    uint64_t messages;      // binary messages applied
+    uint64_t malformed;     // binary datagrams rejected (the rest of the datagram is skipped)
+};
+
+/* Apply one datagram. Returns the number of messages applied (a text
+ * datagram counts as one), -1 if a binary message was malformed. */
+int proto_handle(struct proto_target *target, char *data, size_t len);
+void proto_get_stats(struct proto_stats *stats);
+
+#endif //PROTOCOL_H
@@ -1,7 +1,7 @@
 //open UNIX domain socket for receiving data
+#define _GNU_SOURCE //recvmmsg
 #include <sys/socket.h>
 #include <sys/un.h>
-#include <sys/time.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,18 +9,18 @@
 #include <stdint.h>
 #include <errno.h>
 #include "GC9A01.h"
+#include "socket_rx.h"
 #define SOCKET_PATH "/tmp/gc9a01_socket"
 
-int setup_socket() {
+static char batch_data[SOCKET_BATCH][SOCKET_DGRAM_MAX + 1]; //+1 for the terminator
+static struct socket_rx_stats stats;
+
+int setup_socket(int rcvbuf_bytes) {
     int server_fd;
     struct sockaddr_un server_addr;
-    struct timeval tv = {
-        .tv_sec = 0,
-        .tv_usec = 20000, // 20 ms timeout to avoid blocking forever
-    };
 
-    // Create socket
-    if ((server_fd = socket(AF_UNIX, SOCK_DGRAM, 0)) == -1) {
+    // Create socket; non-blocking, the event loop waits for it to be readable
+    if ((server_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1) {
         perror("socket error");
         return -1;
     }
@@ -43,13 +43,15 @@ int setup_socket() {
         return -1;
     }
 
-    // Set a receive timeout so recvfrom doesn't block forever
-    if (setsockopt(server_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == -1) {
-        perror("setsockopt SO_RCVTIMEO");
-        close(server_fd);
-        return -1;
+    // Room for a burst; the kernel doubles the value and caps it at rmem_max
+    if (rcvbuf_bytes > 0 &&
+        setsockopt(server_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf_bytes, sizeof(rcvbuf_bytes)) == -1) {
+        perror("setsockopt SO_RCVBUF");
     }
-    printf("Socket setup complete at %s\n", SOCKET_PATH);
+    int rcvbuf = 0;
+    socklen_t optlen = sizeof(rcvbuf);
+    getsockopt(server_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &optlen);
+    printf("Socket setup complete at %s (receive buffer %d bytes)\n", SOCKET_PATH, rcvbuf);
 
     return server_fd;
 }
@@ -58,7 +60,7 @@ int receive_data(int server_fd, uint8_t *buffer, size_t buffer_size) {
     ssize_t num_bytes = recvfrom(server_fd, buffer, buffer_size, 0, NULL, NULL);
     if (num_bytes == -1) {
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            // Timeout with no data
+            // Nothing queued
             return 0;
         } else {
             perror("recvfrom error");
@@ -67,13 +69,63 @@ int receive_data(int server_fd, uint8_t *buffer, size_t buffer_size) {
     }
     return (int)num_bytes;
 }
+int receive_batch(int server_fd, socket_rx_fn fn, void *ctx) {
+    struct mmsghdr msgs[SOCKET_BATCH];
+    struct iovec iov[SOCKET_BATCH];
+    int total = 0;
+
+    for (;;) {
+        memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < SOCKET_BATCH; i++) {
+            iov[i].iov_base = batch_data[i];
+            iov[i].iov_len = SOCKET_DGRAM_MAX;
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int n = recvmmsg(server_fd, msgs, SOCKET_BATCH, MSG_DONTWAIT, NULL);
+        stats.syscalls++;
+        if (n == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break; // drained
+            }
+            perror("recvmmsg error");
+            return total > 0 ? total : -1;
+        }
+        for (int i = 0; i < n; i++) {
+            size_t len = msgs[i].msg_len;
+            if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                //half a message: appended text would be cut mid-word, commands fail to parse
+                stats.dropped++;
+                continue;
+            }
+            batch_data[i][len] = '\0';
+            fn(ctx, batch_data[i], len);
+        }
+        total += n;
+        if (n < SOCKET_BATCH) {
+            break; // a short batch means the queue is empty
+        }
+    }
+
+    if (total > 0) {
+        stats.calls++;
+        stats.received += (uint64_t)total;
+        stats.coalesced += (uint64_t)(total - 1);
+    }
+    return total;
+}
+
+void socket_rx_get_stats(struct socket_rx_stats *out) {
+    *out = stats;
+}
+
 void close_socket(int server_fd) {
     close(server_fd);
     unlink(SOCKET_PATH);
 }
 // Example usage
 /*int main() {
-    int server_fd = setup_socket();
+    int server_fd = setup_socket(0);
     if (server_fd == -1) {
         exit(EXIT_FAILURE);
     }  
@@ -5,8 +5,28 @@
 #include <stddef.h>
 
 
-int setup_socket();
+#define SOCKET_RCVBUF_DEFAULT (256 * 1024) //queue for bursts from the translator
+#define SOCKET_BATCH 32                    //datagrams per recvmmsg
+#define SOCKET_DGRAM_MAX (8 + 65535)       //largest protocol message (header, u16 payload); longer datagrams are dropped
+
+struct socket_rx_stats {
+    uint64_t calls;         // receive_batch calls that got anything
+    uint64_t syscalls;      // recvmmsg calls
+    uint64_t received;      // datagrams
+    uint64_t coalesced;     // datagrams that shared a receive_batch call with an earlier one
+    uint64_t dropped;       // datagrams over SOCKET_DGRAM_MAX, never passed on
+};
+
+/* Called for each datagram, NUL-terminated; data is only valid during the call */
+typedef void (*socket_rx_fn)(void *ctx, char *data, size_t len);
+
+int setup_socket(int rcvbuf_bytes);  //rcvbuf_bytes 0: kernel default
 int receive_data(int server_fd, uint8_t *buffer, size_t buffer_size);
+/* Drain every queued datagram, SOCKET_BATCH per syscall, handing each to fn
+ * in arrival order; oversized ones are dropped, not passed on cut short.
+ * Returns the number received, -1 on error. */
+int receive_batch(int server_fd, socket_rx_fn fn, void *ctx);
+void socket_rx_get_stats(struct socket_rx_stats *stats);
 void close_socket(int server_fd);
 
 #endif
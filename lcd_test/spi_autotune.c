@@ -0,0 +1,158 @@
+/* SPI transfer-size and clock calibration: finds the largest transfer
+and fastest clock the panel link survives, and persists them to a profile */
+
+#include "spi_autotune.h"
+#include "GC9A01.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define AUTOTUNE_REPEATS 3 //pattern writes verified per step
+
+//GC9A01 write clock tops out around 100 MHz; the SoC pads usually give up earlier
+static const uint32_t autotune_speeds[] = {
+    5000000, 10000000, 20000000, 27000000, 40000000,
+    50000000, 62500000, 80000000, 100000000,
+};
+
+static const struct GC9A01_frame autotune_frame = {{0,0},{239,239}};
+
+//colour bars that shift with seed, so a stale frame never passes as a fresh one
+static void fill_test_pattern(uint8_t *buf, int seed) {
+    static const uint16_t bars[] = { 0xF800, 0x07E0, 0x001F, 0xFFFF, 0xFFE0, 0x07FF, 0xF81F, 0x0000 };
+    for (int row = 0; row < 240; row++) {
+        for (int col = 0; col < 240; col++) {
+            uint16_t c = bars[((col / 30) + seed) % 8];
+            size_t i = ((size_t)row * 240 + col) * 2;
+            buf[i] = (uint8_t)(c >> 8);
+            buf[i + 1] = (uint8_t)(c & 0xFF);
+        }
+    }
+}
+
+static int verify_step(uint8_t *pattern, uint32_t expected_id, int readback,
+                       spi_verify_hook hook, void *ctx) {
+    for (int rep = 0; rep < AUTOTUNE_REPEATS; rep++) {
+        fill_test_pattern(pattern, rep);
+        GC9A01_set_frame(autotune_frame);
+        GC9A01_write(pattern, 240 * 240 * 2);
+
+        if (readback && GC9A01_read_id() != expected_id) {
+            return -1;
+        }
+        if (hook && hook(GC9A01_spi_get_speed(), ctx) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int spi_autotune_run(spi_verify_hook hook, void *ctx, struct spi_profile *out) {
+    uint32_t base_speed = GC9A01_spi_get_speed();
+    size_t bufsiz = GC9A01_spi_max_transfer();
+
+    //baseline ID at the known-good clock; all zeros/ones means MISO isn't wired
+    uint32_t id = GC9A01_read_id();
+    int readback = (id != 0x000000 && id != 0xFFFFFF);
+    if (!readback && !hook) {
+        fprintf(stderr, "autotune: no RDDID readback (MISO not connected?) and no verify hook\n");
+        return -1;
+    }
+    printf("autotune: display id %06x%s, bufsiz %zu\n", (unsigned)id,
+           readback ? "" : " (readback unavailable)", bufsiz);
+
+    uint8_t *pattern = malloc(240 * 240 * 2);
+    if (!pattern) {
+        perror("malloc test pattern");
+        return -1;
+    }
+
+    //transfer size: double from the current size while it still fits in bufsiz
+    size_t good_xfer = GC9A01_spi_get_xfer_size();
+    if (verify_step(pattern, id, readback, hook, ctx) != 0) {
+        fprintf(stderr, "autotune: baseline %u Hz / %zu bytes failed verification\n",
+                (unsigned)base_speed, good_xfer);
+        free(pattern);
+        return -1;
+    }
+    for (size_t xfer = good_xfer * 2; xfer <= bufsiz; xfer *= 2) {
+        if (GC9A01_spi_set_xfer_size(xfer) != 0 ||
+            verify_step(pattern, id, readback, hook, ctx) != 0) {
+            break;
+        }
+        good_xfer = xfer;
+    }
+    GC9A01_spi_set_xfer_size(good_xfer);
+
+    //clock: step up until a step fails, then fall back to the last good one
+    uint32_t good_speed = base_speed;
+    for (size_t i = 0; i < sizeof(autotune_speeds) / sizeof(autotune_speeds[0]); i++) {
+        uint32_t hz = autotune_speeds[i];
+        if (hz <= base_speed) {
+            continue;
+        }
+        if (GC9A01_spi_set_speed(hz) != 0 ||
+            verify_step(pattern, id, readback, hook, ctx) != 0) {
+            printf("autotune: %u Hz failed\n", (unsigned)hz);
+            break;
+        }
+        printf("autotune: %u Hz ok\n", (unsigned)hz);
+        good_speed = hz;
+    }
+    GC9A01_spi_set_speed(good_speed);
+    free(pattern);
+
+    out->speed_hz = good_speed;
+    out->xfer_size = good_xfer;
+    printf("autotune: using %u Hz, %zu byte transfers\n", (unsigned)good_speed, good_xfer);
+    return 0;
+}
+
+int spi_profile_load(const char *path, struct spi_profile *profile) {
+    unsigned long speed_hz = 0;
+    unsigned long xfer_size = 0;
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+    int n = fscanf(f, "speed_hz=%lu\nxfer_size=%lu\n", &speed_hz, &xfer_size);
+    fclose(f);
+    if (n != 2 || speed_hz == 0 || xfer_size == 0) {
+        fprintf(stderr, "ignoring malformed SPI profile %s\n", path);
+        return -1;
+    }
+    profile->speed_hz = (uint32_t)speed_hz;
+    profile->xfer_size = (size_t)xfer_size;
+    return 0;
+}
+
+int spi_profile_save(const char *path, const struct spi_profile *profile) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror("fopen spi profile");
+        return -1;
+    }
+    fprintf(f, "speed_hz=%lu\nxfer_size=%lu\n",
+            (unsigned long)profile->speed_hz, (unsigned long)profile->xfer_size);
+    if (fclose(f) != 0) {
+        perror("fclose spi profile");
+        return -1;
+    }
+    return 0;
+}
+
+int spi_profile_apply(const struct spi_profile *profile) {
+    if (GC9A01_spi_set_xfer_size(profile->xfer_size) != 0) {
+        //bufsiz was lowered since calibration; keep the current size
+        fprintf(stderr, "SPI profile transfer size %zu exceeds bufsiz %zu\n",
+                profile->xfer_size, GC9A01_spi_max_transfer());
+    }
+    if (GC9A01_spi_set_speed(profile->speed_hz) != 0) {
+        return -1;
+    }
+    printf("SPI profile: %u Hz, %zu byte transfers\n",
+           (unsigned)GC9A01_spi_get_speed(), GC9A01_spi_get_xfer_size());
+    return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef SPI_AUTOTUNE_H
+#define SPI_AUTOTUNE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SPI_PROFILE_PATH "./gc9a01_spi.profile"
+
+struct spi_profile {
+    uint32_t speed_hz;      // highest clock that passed verification
+    size_t xfer_size;       // largest single transfer that passed, <= spidev bufsiz
+};
+
+/* Optional extra check run after each test-pattern write, e.g. a camera
+ * or a human looking at the panel. Return 0 if the step passed. */
+typedef int (*spi_verify_hook)(uint32_t speed_hz, void *ctx);
+
+/* Grow the transfer size up to spidev's bufsiz, then step the SPI clock
+ * up from the current speed, writing a test pattern and verifying each
+ * step by RDDID readback and/or the hook. Leaves the winners applied. Without MISO and without a hook there is
+ * nothing to verify against and calibration fails. */
+int spi_autotune_run(spi_verify_hook hook, void *ctx, struct spi_profile *out);
+
+int spi_profile_load(const char *path, struct spi_profile *profile);
+int spi_profile_save(const char *path, const struct spi_profile *profile);
+int spi_profile_apply(const struct spi_profile *profile);
+
+#endif //SPI_AUTOTUNE_H
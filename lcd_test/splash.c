@@ -0,0 +1,42 @@
+/* boot splash: mmap the prebuilt asset and hand it to SPI as-is,
+nothing is rendered or converted on the boot path */
+
+#include "splash.h"
+#include "GC9A01.h"
+#include "framebuffer.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SPLASH_BYTES (FB_WIDTH * FB_HEIGHT * 2)
+
+int splash_show(const char *path) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size != SPLASH_BYTES) {
+        fprintf(stderr, "splash asset %s has the wrong size\n", path);
+        close(fd);
+        return -1;
+    }
+    uint8_t *asset = mmap(NULL, SPLASH_BYTES, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (asset == MAP_FAILED) {
+        perror("mmap splash");
+        return -1;
+    }
+
+    const struct GC9A01_frame full_frame = {{0,0},{FB_WIDTH - 1, FB_HEIGHT - 1}};
+    GC9A01_set_frame(full_frame);
+    GC9A01_write(asset, SPLASH_BYTES);
+    fb_shadow_invalidate(); //bypassed the framebuffer
+
+    munmap(asset, SPLASH_BYTES);
+    return 0;
+}
@@ -0,0 +1,11 @@
+#ifndef SPLASH_H
+#define SPLASH_H
+
+#define SPLASH_PATH "./splash.rgb565"
+
+/* Stream the prebuilt splash asset (RGB565, panel stream order, made by
+ * tools/mksplash at build time) straight to the panel. Returns -1 if the
+ * asset is missing or the wrong size. */
+int splash_show(const char *path);
+
+#endif //SPLASH_H
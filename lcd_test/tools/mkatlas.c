@@ -0,0 +1,181 @@
+/* build-time font atlas converter: reads a BDF font (e.g. GNU Unifont)
+and writes the atlas font_atlas.c mmaps, one 4 KiB-aligned block per
+256 code points that have any glyph. Structs are written in host order,
+which for the build host and the Jetson alike is little-endian. */
+
+#include "../font_atlas.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct font_atlas_glyph *blocks[FONT_ATLAS_PAGES];
+
+static int write_zeros(FILE *f, long n) {
+    for (; n > 0; n--) {
+        if (fputc(0, f) == EOF) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+//glyphs are placed on a 16-row cell with the baseline ascent rows down
+static int read_bdf(FILE *f, int *glyphs, int *skipped) {
+    char line[256];
+    int ascent = -1, box_h = 0, box_yoff = 0;
+    long enc = -1;
+    int dwidth = 0, w = 0, h = 0, xoff = 0, yoff = 0;
+    int in_bitmap = 0, row = 0;
+    uint16_t rows[FONT_ATLAS_HEIGHT];
+
+    while (fgets(line, sizeof(line), f)) {
+        if (in_bitmap) {
+            if (strncmp(line, "ENDCHAR", 7) == 0) {
+                in_bitmap = 0;
+                if (enc < 128) {
+                    continue; //ASCII stays with the built-in font
+                }
+                if (enc > 0x10FFFF || dwidth > 16 || w > 16) {
+                    (*skipped)++; //nothing wider than two cells
+                    continue;
+                }
+                struct font_atlas_glyph **block = &blocks[enc / FONT_ATLAS_BLOCK];
+                if (!*block) {
+                    *block = calloc(FONT_ATLAS_BLOCK, sizeof(struct font_atlas_glyph));
+                    if (!*block) {
+                        perror("calloc");
+                        return -1;
+                    }
+                }
+                struct font_atlas_glyph *g = &(*block)[enc % FONT_ATLAS_BLOCK];
+                g->width = dwidth <= 8 ? 8 : 16;
+                memcpy(g->rows, rows, sizeof(rows));
+                (*glyphs)++;
+                continue;
+            }
+            //one hex row, leftmost pixel in the top bit
+            size_t digits = strspn(line, "0123456789abcdefABCDEF");
+            unsigned long bits = strtoul(line, NULL, 16);
+            int y = ascent - (yoff + h) + row++;
+            if (y < 0 || y >= FONT_ATLAS_HEIGHT) {
+                continue;
+            }
+            for (int col = 0; col < w; col++) {
+                int x = xoff + col;
+                if (x >= 0 && x < 16 && (size_t)col < digits * 4 && ((bits >> (digits * 4 - 1 - (size_t)col)) & 1)) {
+                    rows[y] |= (uint16_t)(0x8000u >> x);
+                }
+            }
+            continue;
+        }
+
+        if (sscanf(line, "FONT_ASCENT %d", &ascent) == 1 ||
+            sscanf(line, "DWIDTH %d", &dwidth) == 1) {
+            continue;
+        }
+        if (sscanf(line, "FONTBOUNDINGBOX %*d %d %*d %d", &box_h, &box_yoff) == 2) {
+            continue;
+        }
+        if (strncmp(line, "STARTCHAR", 9) == 0) {
+            enc = -1;
+            dwidth = 0;
+            w = h = xoff = yoff = 0;
+        } else if (sscanf(line, "ENCODING %ld", &enc) == 1) {
+            continue;
+        } else if (sscanf(line, "BBX %d %d %d %d", &w, &h, &xoff, &yoff) == 4) {
+            if (dwidth == 0) {
+                dwidth = w;
+            }
+        } else if (strncmp(line, "BITMAP", 6) == 0) {
+            if (ascent < 0) {
+                ascent = box_h + box_yoff; //no FONT_ASCENT property
+            }
+            in_bitmap = 1;
+            row = 0;
+            memset(rows, 0, sizeof(rows));
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s OUTPUT FONT.bdf\n", argv[0]);
+        return 1;
+    }
+
+    FILE *in = fopen(argv[2], "r");
+    if (!in) {
+        perror("fopen font");
+        return 1;
+    }
+    int glyphs = 0, skipped = 0;
+    if (read_bdf(in, &glyphs, &skipped) != 0) {
+        return 1;
+    }
+    fclose(in);
+
+    uint32_t page_count = 0;
+    for (uint32_t b = 0; b < FONT_ATLAS_PAGES; b++) {
+        if (blocks[b]) {
+            page_count = b + 1;
+        }
+    }
+
+    struct font_atlas_header h = {0};
+    memcpy(h.magic, FONT_ATLAS_MAGIC, 4);
+    h.version = FONT_ATLAS_VERSION;
+    h.glyph_height = FONT_ATLAS_HEIGHT;
+    h.page_count = page_count;
+    h.dir_offset = sizeof(h);
+
+    uint32_t *dir = calloc(page_count ? page_count : 1, sizeof(uint32_t));
+    if (!dir) {
+        perror("calloc");
+        return 1;
+    }
+    long offset = (long)(sizeof(h) + page_count * sizeof(uint32_t));
+    int used = 0;
+    for (uint32_t b = 0; b < page_count; b++) {
+        if (blocks[b]) {
+            offset = (offset + FONT_ATLAS_ALIGN - 1) / FONT_ATLAS_ALIGN * FONT_ATLAS_ALIGN;
+            dir[b] = (uint32_t)offset;
+            offset += FONT_ATLAS_BLOCK * (long)sizeof(struct font_atlas_glyph);
+            used++;
+        }
+    }
+
+    FILE *out = fopen(argv[1], "wb");
+    if (!out) {
+        perror("fopen");
+        return 1;
+    }
+    int err = fwrite(&h, sizeof(h), 1, out) != 1 ||
+              fwrite(dir, sizeof(uint32_t), page_count, out) != page_count;
+    long pos = (long)(sizeof(h) + page_count * sizeof(uint32_t));
+    for (uint32_t b = 0; b < page_count && !err; b++) {
+        if (!blocks[b]) {
+            continue;
+        }
+        err = write_zeros(out, dir[b] - pos) != 0 ||
+              fwrite(blocks[b], sizeof(struct font_atlas_glyph), FONT_ATLAS_BLOCK, out) != FONT_ATLAS_BLOCK;
+        pos = dir[b] + FONT_ATLAS_BLOCK * (long)sizeof(struct font_atlas_glyph);
+    }
+    if (err || fclose(out) != 0) {
+        perror("write atlas");
+        return 1;
+    }
+
+    printf("%s: %d glyphs in %d blocks, %ld bytes", argv[1], glyphs, used, pos);
+    if (skipped) {
+        printf(" (%d glyphs skipped: wider than 16 px or not Unicode)", skipped);
+    }
+    printf("\n");
+    for (uint32_t b = 0; b < page_count; b++) {
+        free(blocks[b]);
+    }
+    free(dir);
+    return 0;
+}
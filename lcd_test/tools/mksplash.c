@@ -0,0 +1,41 @@
+/* build-time splash generator: renders the startup screen once and
+writes it as RGB565 in panel stream order, ready to go straight to SPI */
+
+#include "../framebuffer.h"
+#include "../startscreen.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s OUTPUT\n", argv[0]);
+        return 1;
+    }
+
+    uint8_t *framebuffer = calloc(1, FB_SIZE);
+    uint8_t *packed = malloc(FB_WIDTH * FB_HEIGHT * 2);
+    if (!framebuffer || !packed) {
+        perror("malloc");
+        return 1;
+    }
+
+    draw_startup_screen(framebuffer);
+    const struct GC9A01_frame full_frame = {{0,0},{FB_WIDTH - 1, FB_HEIGHT - 1}};
+    size_t len = fb_pack_rgb565(framebuffer, full_frame, packed);
+
+    FILE *f = fopen(argv[1], "wb");
+    if (!f) {
+        perror("fopen");
+        return 1;
+    }
+    if (fwrite(packed, 1, len, f) != len || fclose(f) != 0) {
+        perror("write splash");
+        return 1;
+    }
+
+    free(packed);
+    free(framebuffer);
+    return 0;
+}
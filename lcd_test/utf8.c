@@ -0,0 +1,83 @@
+/* UTF-8 decoding for the incoming text stream */
+
+#include "utf8.h"
+
+//shortest form only, no surrogates, nothing past U+10FFFF
+static int utf8_valid(uint32_t cp, int extra) {
+    static const uint32_t min_cp[4] = { 0, 0x80, 0x800, 0x10000 };
+    return cp >= min_cp[extra] && !(cp >= 0xD800 && cp <= 0xDFFF) && cp <= 0x10FFFF;
+}
+
+uint32_t utf8_decode(const char **s) {
+    const unsigned char *p = (const unsigned char *)*s;
+    uint32_t cp;
+    int extra;
+
+    if (p[0] < 0x80) {
+        if (p[0]) {
+            (*s)++;
+        }
+        return p[0];
+    }
+    if ((p[0] & 0xE0) == 0xC0) {
+        cp = p[0] & 0x1F;
+        extra = 1;
+    } else if ((p[0] & 0xF0) == 0xE0) {
+        cp = p[0] & 0x0F;
+        extra = 2;
+    } else if ((p[0] & 0xF8) == 0xF0) {
+        cp = p[0] & 0x07;
+        extra = 3;
+    } else {
+        (*s)++; //stray continuation byte or 0xF8..0xFF
+        return UTF8_REPLACEMENT;
+    }
+
+    for (int i = 1; i <= extra; i++) {
+        if ((p[i] & 0xC0) != 0x80) { //also stops at the NUL of a truncated sequence
+            (*s)++;
+            return UTF8_REPLACEMENT;
+        }
+        cp = (cp << 6) | (p[i] & 0x3F);
+    }
+
+    if (!utf8_valid(cp, extra)) {
+        (*s)++;
+        return UTF8_REPLACEMENT;
+    }
+    *s += extra + 1;
+    return cp;
+}
+
+int utf8_stream_feed(struct utf8_stream *st, uint8_t byte, uint32_t out[2]) {
+    int n = 0;
+
+    if (st->need) {
+        if ((byte & 0xC0) == 0x80) {
+            st->cp = (st->cp << 6) | (byte & 0x3F);
+            if (--st->need == 0) {
+                out[n++] = utf8_valid(st->cp, st->len - 1) ? st->cp : UTF8_REPLACEMENT;
+            }
+            return n;
+        }
+        st->need = 0;
+        out[n++] = UTF8_REPLACEMENT; //truncated, byte starts something new
+    }
+
+    if (byte < 0x80) {
+        out[n++] = byte;
+    } else if ((byte & 0xE0) == 0xC0) {
+        st->cp = byte & 0x1F;
+        st->need = 1;
+    } else if ((byte & 0xF0) == 0xE0) {
+        st->cp = byte & 0x0F;
+        st->need = 2;
+    } else if ((byte & 0xF8) == 0xF0) {
+        st->cp = byte & 0x07;
+        st->need = 3;
+    } else {
+        out[n++] = UTF8_REPLACEMENT;
+    }
+    st->len = st->need + 1;
+    return n;
+}
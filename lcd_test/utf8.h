@@ -0,0 +1,27 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <stdint.h>
+
+#define UTF8_REPLACEMENT 0xFFFDu //shown for malformed input
+
+/* Decode the code point at *s and advance *s past it. Returns 0 at the
+ * terminating NUL (without advancing). Malformed, overlong or truncated
+ * sequences and surrogates decode to UTF8_REPLACEMENT, consuming one byte,
+ * so a bad byte never swallows the characters after it. */
+uint32_t utf8_decode(const char **s);
+
+/* Incremental decoder for byte streams, where a sequence may be split
+ * across reads. Zero-initialise. */
+struct utf8_stream {
+    uint32_t cp;    // bits gathered so far
+    int need;       // continuation bytes still to come
+    int len;        // bytes in the current sequence
+};
+
+/* Feed one byte; returns how many code points (0-2) it completed into out.
+ * A malformed sequence yields UTF8_REPLACEMENT; a byte that cuts one short
+ * yields UTF8_REPLACEMENT for it and is then decoded on its own. */
+int utf8_stream_feed(struct utf8_stream *st, uint8_t byte, uint32_t out[2]);
+
+#endif //UTF8_H
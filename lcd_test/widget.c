@@ -0,0 +1,288 @@
+/* widgets: screen regions with their own render callback and refresh
+policy, plus the built-in console, battery gauge and clock */
+
+#include "widget.h"
+#include "glyph_cache.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+struct battery_state {
+    const char *path;
+    int level;      // percent, -1 unknown
+    int shown;      // level currently drawn, -2 nothing drawn yet
+};
+
+struct clock_state {
+    char shown[8];
+};
+
+static struct widget widgets[WIDGET_MAX];
+static int widget_count = 0;
+//built-in widget state, one slot per widget
+static struct battery_state battery_state[WIDGET_MAX];
+static struct clock_state clock_state[WIDGET_MAX];
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+struct widget *widget_add(const char *name, struct GC9A01_frame frame, widget_render_fn render,
+                          enum widget_refresh policy, uint32_t period_ms, void *ctx) {
+    if (widget_count == WIDGET_MAX) {
+        fprintf(stderr, "widget %s: all %d slots in use\n", name, WIDGET_MAX);
+        return NULL;
+    }
+    struct widget *w = &widgets[widget_count++];
+    w->name = name;
+    w->frame = frame;
+    w->render = render;
+    w->policy = policy;
+    w->period_ms = period_ms;
+    w->ctx = ctx;
+    w->dirty = 1; //first refresh draws it
+    w->due_ns = 0;
+    w->layer = NULL;
+    return w;
+}
+
+void widget_invalidate(struct widget *w) {
+    if (w) {
+        w->dirty = 1;
+    }
+}
+
+void widget_reset(void) {
+    widget_count = 0;
+}
+
+static int widget_due(const struct widget *w, uint64_t now) {
+    return w->dirty || (w->policy == WIDGET_PERIODIC && now >= w->due_ns);
+}
+
+int widget_pending(void) {
+    uint64_t now = monotonic_ns();
+    for (int i = 0; i < widget_count; i++) {
+        if (widget_due(&widgets[i], now)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int widget_timeout_ms(int idle_ms) {
+    uint64_t now = monotonic_ns();
+    int timeout = idle_ms;
+    for (int i = 0; i < widget_count; i++) {
+        const struct widget *w = &widgets[i];
+        if (widget_due(w, now)) {
+            return 0;
+        }
+        if (w->policy == WIDGET_PERIODIC) {
+            int ms = (int)((w->due_ns - now + 999999) / 1000000);
+            if (timeout < 0 || ms < timeout) {
+                timeout = ms;
+            }
+        }
+    }
+    return timeout;
+}
+
+//a widget only ever sends its own rectangle, or damages its own part of its layer
+static void widget_damage(struct widget *w, struct GC9A01_frame c, struct fb_damage *out) {
+    if (c.start.X < w->frame.start.X) c.start.X = w->frame.start.X;
+    if (c.start.Y < w->frame.start.Y) c.start.Y = w->frame.start.Y;
+    if (c.end.X > w->frame.end.X) c.end.X = w->frame.end.X;
+    if (c.end.Y > w->frame.end.Y) c.end.Y = w->frame.end.Y;
+    if (c.start.X > c.end.X || c.start.Y > c.end.Y) {
+        return;
+    }
+    if (w->layer) {
+        comp_layer_damage(w->layer, c.start.X, c.start.Y, c.end.X - c.start.X + 1, c.end.Y - c.start.Y + 1);
+    } else {
+        fb_damage_add(out, c);
+    }
+}
+
+int widget_refresh(uint8_t *framebuffer, struct fb_damage *out) {
+    uint64_t now = monotonic_ns();
+    struct fb_damage drawn;
+    int rendered = 0;
+
+    //whatever was drawn outside the widgets goes out as well
+    fb_damage_take(out);
+
+    for (int i = 0; i < widget_count; i++) {
+        struct widget *w = &widgets[i];
+        if (!widget_due(w, now)) {
+            continue;
+        }
+        if (w->policy == WIDGET_PERIODIC) {
+            w->due_ns = now + (uint64_t)w->period_ms * 1000000ull; //render may move it
+        }
+        int whole = w->render(w, w->layer ? comp_layer_pixels(w->layer) : framebuffer);
+        fb_damage_take(&drawn);
+        if (whole) {
+            widget_damage(w, w->frame, out);
+        }
+        for (int r = 0; r < drawn.count; r++) {
+            widget_damage(w, drawn.rects[r], out);
+        }
+        if (drawn.scroll_pending) {
+            out->scroll_pending = 1;
+            out->scroll_start = drawn.scroll_start;
+        }
+        w->dirty = 0;
+        rendered++;
+    }
+
+    //layered widgets go out as the tiles their damage rebuilt (also those the background's did)
+    if (comp_composite(framebuffer) > 0) {
+        fb_damage_take(&drawn);
+        for (int r = 0; r < drawn.count; r++) {
+            fb_damage_add(out, drawn.rects[r]);
+        }
+    }
+    return rendered;
+}
+
+struct comp_layer *widget_layers_create(void) {
+    const struct GC9A01_frame screen = {{0, 0}, {FB_WIDTH - 1, FB_HEIGHT - 1}};
+    struct comp_layer *background = comp_layer_create(screen, 255, COMP_NO_KEY);
+    if (!background) {
+        return NULL;
+    }
+    for (int i = 0; i < widget_count; i++) {
+        widgets[i].layer = comp_layer_create(widgets[i].frame, 255, GLYPH_RGB(0, 0, 0));
+        if (!widgets[i].layer) {
+            for (; i >= 0; i--) {
+                widgets[i].layer = NULL;
+            }
+            comp_destroy();
+            return NULL;
+        }
+        widgets[i].dirty = 1; //its layer starts out empty
+    }
+    return background;
+}
+
+//console: the scrolling text rows
+static int console_render(struct widget *w, uint8_t *framebuffer) {
+    (void)w;
+    textbuffer_render(framebuffer); //records per-cell damage
+    return 0;
+}
+
+struct widget *widget_add_console(struct GC9A01_frame frame) {
+    return widget_add("console", frame, console_render, WIDGET_ON_CHANGE, 0, NULL);
+}
+
+//battery: upright cell outline with a nub, filled from the bottom
+static int battery_render(struct widget *w, uint8_t *framebuffer) {
+    struct battery_state *b = w->ctx;
+
+    if (b->path) {
+        FILE *f = fopen(b->path, "r");
+        int level = -1;
+        if (f) {
+            if (fscanf(f, "%d", &level) != 1 || level < 0 || level > 100) {
+                level = -1;
+            }
+            fclose(f);
+        }
+        b->level = level;
+    }
+    if (b->level == b->shown) {
+        return 0;
+    }
+    b->shown = b->level;
+
+    int x = w->frame.start.X, y = w->frame.start.Y;
+    int fw = w->frame.end.X - x + 1, fh = w->frame.end.Y - y + 1;
+    int body_w = fw * 2 / 3;
+    int body_x = x + (fw - body_w) / 2;
+    int nub_w = body_w / 2;
+    int body_y = y + 2;
+    int body_h = fh - 2;
+    uint8_t c = b->level < 0 ? 96 : 255; //grey outline when the level is unknown
+
+    fb_fill_rect(framebuffer, x, y, fw, fh, 0, 0, 0);
+    fb_fill_rect(framebuffer, body_x + (body_w - nub_w) / 2, y, nub_w, 2, c, c, c);
+    fb_fill_rect(framebuffer, body_x, body_y, body_w, 1, c, c, c);
+    fb_fill_rect(framebuffer, body_x, body_y + body_h - 1, body_w, 1, c, c, c);
+    fb_fill_rect(framebuffer, body_x, body_y, 1, body_h, c, c, c);
+    fb_fill_rect(framebuffer, body_x + body_w - 1, body_y, 1, body_h, c, c, c);
+    if (b->level > 0) {
+        int inner_h = body_h - 4;
+        int fill = (inner_h * b->level + 99) / 100;
+        int low = b->level <= 20;
+        fb_fill_rect(framebuffer, body_x + 2, body_y + 2 + inner_h - fill, body_w - 4, fill,
+                     low ? 255 : 0, low ? 0 : 255, 0);
+    }
+    return 0;
+}
+
+struct widget *widget_add_battery(struct GC9A01_frame frame, const char *capacity_path) {
+    struct widget *w = widget_add("battery", frame, battery_render,
+                                  capacity_path ? WIDGET_PERIODIC : WIDGET_ON_CHANGE, BATTERY_PERIOD_MS, NULL);
+    if (!w) {
+        return NULL;
+    }
+    //the slot follows the widget's, so a full table never touches live state
+    struct battery_state *b = &battery_state[w - widgets];
+    b->path = capacity_path;
+    b->level = -1;
+    b->shown = -2;
+    w->ctx = b;
+    return w;
+}
+
+void widget_battery_set_level(struct widget *w, int percent) {
+    struct battery_state *b = w->ctx;
+    //a level set from outside replaces the capacity file from now on
+    b->path = NULL;
+    w->policy = WIDGET_ON_CHANGE;
+    if (b->level != percent) {
+        b->level = percent;
+        w->dirty = 1;
+    }
+}
+
+//clock: HH:MM, redrawn when the minute turns, and only then due again
+static int clock_render(struct widget *w, uint8_t *framebuffer) {
+    struct clock_state *c = w->ctx;
+    char now_str[8];
+    struct timespec rt;
+    struct tm tm;
+
+    clock_gettime(CLOCK_REALTIME, &rt);
+    localtime_r(&rt.tv_sec, &tm);
+    //next wakeup on the minute boundary (a leap second just wakes once more)
+    int secs = 60 - tm.tm_sec > 0 ? 60 - tm.tm_sec : 1;
+    w->due_ns = monotonic_ns() + (uint64_t)secs * 1000000000ull - (uint64_t)rt.tv_nsec;
+
+    strftime(now_str, sizeof(now_str), "%H:%M", &tm);
+    if (strcmp(now_str, c->shown) == 0) {
+        return 0;
+    }
+    snprintf(c->shown, sizeof(c->shown), "%s", now_str);
+    fb_fill_rect(framebuffer, w->frame.start.X, w->frame.start.Y,
+                 w->frame.end.X - w->frame.start.X + 1, w->frame.end.Y - w->frame.start.Y + 1, 0, 0, 0);
+    fb_draw_string(framebuffer, now_str, w->frame.start.X, w->frame.start.Y, 200, 200, 200);
+    return 0;
+}
+
+struct widget *widget_add_clock(struct GC9A01_frame frame) {
+    struct widget *w = widget_add("clock", frame, clock_render, WIDGET_PERIODIC, 60000, NULL);
+    if (!w) {
+        return NULL;
+    }
+    struct clock_state *c = &clock_state[w - widgets];
+    c->shown[0] = '\0';
+    w->ctx = c;
+    return w;
+}
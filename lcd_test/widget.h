@@ -0,0 +1,73 @@
+#ifndef WIDGET_H
+#define WIDGET_H
+
+#include <stdint.h>
+#include "GC9A01.h"
+#include "framebuffer.h"
+#include "compositor.h"
+
+/* Widgets: independent screen regions (text console, battery gauge,
+ * clock, ...) that each own a rectangle, a render callback and a
+ * refresh policy. On-change widgets render when invalidated; periodic
+ * ones also every period_ms, or at the deadline their render sets
+ * in due_ns. widget_refresh() renders only the widgets
+ * that are dirty or due and returns what they drew, clipped to their
+ * own rectangles, so each one goes out through its own small window.
+ *
+ * With widget_layers_create(), each widget draws into its own compositor
+ * layer instead, over a background layer; widget_refresh() then moves
+ * their damage to the layers and returns the tiles comp_composite()
+ * rebuilt, so a widget never redraws what lies under or over it.
+ */
+
+#define WIDGET_MAX 8
+#define BATTERY_CAPACITY_PATH "/sys/class/power_supply/battery/capacity"
+#define BATTERY_PERIOD_MS 10000
+
+enum widget_refresh {
+    WIDGET_ON_CHANGE,
+    WIDGET_PERIODIC,
+};
+
+struct widget;
+/* Draw into framebuffer (the widget's layer, if it has one) inside w->frame. Drawing through fb_draw_* /
+ * fb_fill_rect records damage, which is what gets sent; return 1 to send
+ * the whole rectangle instead (e.g. after drawing with fb_set_pixel). */
+typedef int (*widget_render_fn)(struct widget *w, uint8_t *framebuffer);
+
+struct widget {
+    const char *name;
+    struct GC9A01_frame frame;  // framebuffer coords, inclusive
+    widget_render_fn render;
+    enum widget_refresh policy;
+    uint32_t period_ms;         // WIDGET_PERIODIC only
+    void *ctx;
+    int dirty;
+    uint64_t due_ns;            // next periodic refresh; render may move it (e.g. to a clock boundary)
+    struct comp_layer *layer;   // NULL: draws straight into the framebuffer
+};
+
+struct widget *widget_add(const char *name, struct GC9A01_frame frame, widget_render_fn render,
+                          enum widget_refresh policy, uint32_t period_ms, void *ctx);
+void widget_invalidate(struct widget *w);
+void widget_reset(void);                        //drop every widget
+
+int widget_pending(void);                       //some widget is dirty or due
+int widget_timeout_ms(int idle_ms);             //until the next one is; idle_ms if none is periodic
+int widget_refresh(uint8_t *framebuffer, struct fb_damage *out); //returns widgets rendered
+/* Give every widget added so far its own layer, keyed on black so what
+ * lies below shows around what it draws, stacked over an opaque
+ * full-screen background layer, which is returned for drawing outside
+ * the widgets. Every widget redraws once. NULL, with no layers made, if
+ * the compositor is out of layers or memory: widgets keep drawing
+ * straight into the framebuffer. */
+struct comp_layer *widget_layers_create(void);
+
+/* Built-in widgets */
+struct widget *widget_add_console(struct GC9A01_frame frame);  //textbuffer_render; invalidate on new text
+/* Reads capacity_path (percent) every BATTERY_PERIOD_MS; NULL path: level set by widget_battery_set_level */
+struct widget *widget_add_battery(struct GC9A01_frame frame, const char *capacity_path);
+void widget_battery_set_level(struct widget *w, int percent);  //-1: unknown; stops reading the file
+struct widget *widget_add_clock(struct GC9A01_frame frame);    //HH:MM, local time; wakes once a minute
+
+#endif //WIDGET_H